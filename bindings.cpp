@@ -1,10 +1,204 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include "db.h"
+#include "indexer.h"
+#include "snapshot.h"
+#include "report.h"
 
 namespace py = pybind11;
 
+//тяжелые запросы выполняются без GIL
+using nogil = py::call_guard<py::gil_scoped_release>;
+
+//курсор может быть общим для нескольких потоков Python: fill/pop под мьютексом курсора
+//мьютекс ждется только без GIL, иначе держащий его поток не сможет вернуть GIL
+template <typename Row>
+void bind_cursor(py::module_& m, const char* name) {
+    py::class_<Cursor<Row>>(m, name)
+        .def("__iter__", [](Cursor<Row>& c) -> Cursor<Row>& { return c; }, py::return_value_policy::reference_internal)
+        .def("__next__", [](Cursor<Row>& c) {
+            Row row;
+            bool ok;
+            std::unique_lock<std::mutex> lock(c.mutex(), std::try_to_lock);
+            if (lock.owns_lock() && c.buffered()) {
+                ok = c.pop(row);
+            } else {
+                py::gil_scoped_release release;
+                if (!lock.owns_lock()) lock.lock();
+                ok = c.next(row);
+            }
+            lock.unlock();
+            if (!ok) throw py::stop_iteration();
+            return row;
+        })
+        .def("next_chunk", [](Cursor<Row>& c) {
+            std::vector<Row> out;
+            {
+                py::gil_scoped_release release;
+                std::lock_guard<std::mutex> lock(c.mutex());
+                if (!c.buffered()) c.fill();
+                Row row;
+                while (c.pop(row)) out.push_back(std::move(row));
+            }
+            return out;
+        });
+}
+
+//результат фоновой задачи
+template <typename T>
+struct Future {
+    std::shared_future<T> f;
+};
+
+template <typename T>
+void bind_future(py::module_& m, const char* name) {
+    py::class_<Future<T>>(m, name)
+        .def("done", [](const Future<T>& fu) {
+            return fu.f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        })
+        .def("result", [](const Future<T>& fu, py::object timeout) {
+            double secs = timeout.is_none() ? -1.0 : timeout.cast<double>();
+            bool ready = true;
+            {
+                py::gil_scoped_release release;
+                if (secs < 0) fu.f.wait();
+                else ready = fu.f.wait_for(std::chrono::duration<double>(secs)) == std::future_status::ready;
+            }
+            if (!ready) {
+                PyErr_SetString(PyExc_TimeoutError, "result not ready");
+                throw py::error_already_set();
+            }
+            return fu.f.get();
+        }, py::arg("timeout") = py::none());
+}
+
+//потоки задач *_async: их число ограничено, пул принадлежит модулю
+//при выходе интерпретатора (atexit) невыполненные задачи отменяются, потоки дожидаются текущих и завершаются
+class AsyncPool {
+public:
+    using Task = std::function<void(bool cancelled)>;
+
+    explicit AsyncPool(size_t size) : size(size ? size : 1) {}
+    ~AsyncPool() { shutdown(); }
+
+    void submit(Task task) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!stopping) {
+                queue.push_back(std::move(task));
+                if (threads.size() < size && threads.size() < queue.size() + busy) threads.emplace_back([this] { work(); });
+                cv.notify_one();
+                return;
+            }
+        }
+        task(true);
+    }
+
+    void shutdown() {
+        std::deque<Task> cancelled;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+            cancelled.swap(queue);
+        }
+        cv.notify_all();
+        for (auto& task : cancelled) task(true);
+        for (auto& th : threads) if (th.joinable()) th.join();
+    }
+
+private:
+    void work() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true) {
+            cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            Task task = std::move(queue.front());
+            queue.pop_front();
+            busy++;
+            lock.unlock();
+            task(false);
+            lock.lock();
+            busy--;
+        }
+    }
+
+    size_t size;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<Task> queue;
+    std::vector<std::thread> threads;
+    size_t busy = 0;
+    bool stopping = false;
+};
+
+static AsyncPool& async_pool() {
+    static AsyncPool pool(std::min(4u, std::max(1u, std::thread::hardware_concurrency())));
+    return pool;
+}
+
+//задача на своем соединении, чтобы отчеты шли параллельно с вызывающим потоком
+//соединение видит только закоммиченные данные, поэтому внутри begin() без commit() - ошибка
+//IMMUTABLE передается дальше, READ_WRITE - нет: задачи только читают, а открытие на запись
+//ждало бы блокировку, которую держит вызывающий
+template <typename Fn>
+auto run_async(const DB& db, Fn fn) -> Future<decltype(fn(std::declval<DB&>()))> {
+    if (db.in_transaction()) throw std::runtime_error("commit before *_async: the task runs on its own connection and sees only committed data");
+    using T = decltype(fn(std::declval<DB&>()));
+    auto promise = std::make_shared<std::promise<T>>();
+    std::string path = db.path();
+    OpenMode mode = db.mode() == OpenMode::IMMUTABLE ? OpenMode::IMMUTABLE : OpenMode::READ_ONLY;
+    async_pool().submit([promise, path, mode, fn](bool cancelled) {
+        if (cancelled) {
+            promise->set_exception(std::make_exception_ptr(std::runtime_error("analyzer is shutting down")));
+            return;
+        }
+        try {
+            DB local(path, mode);
+            promise->set_value(fn(local));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+    return Future<T>{promise->get_future().share()};
+}
+
+//kwargs -> QueryFilter, неизвестный ключ - TypeError
+static QueryFilter to_filter(const py::kwargs& kw) {
+    QueryFilter f;
+    for (auto item : kw) {
+        std::string key = py::cast<std::string>(item.first);
+        py::handle v = item.second;
+        if (v.is_none()) continue;
+        if (key == "path_prefix") f.path_prefix = py::cast<std::string>(v);
+        else if (key == "path_glob") f.path_glob = py::cast<std::string>(v);
+        else if (key == "file_ids") f.file_ids = py::cast<std::vector<int>>(v);
+        else if (key == "module_prefix") f.module_prefix = py::cast<std::string>(v);
+        else if (key == "sinks") f.sinks = py::cast<std::vector<std::string>>(v);
+        else if (key == "line_min") f.line_min = py::cast<int>(v);
+        else if (key == "line_max") f.line_max = py::cast<int>(v);
+        else if (key == "limit") f.limit = py::cast<int>(v);
+        else if (key == "offset") f.offset = py::cast<int>(v);
+        else throw py::type_error("unknown filter: " + key);
+    }
+    return f;
+}
+
 PYBIND11_MODULE(analyzer, m) {
+    //потоки *_async не должны пережить интерпретатор
+    py::module_::import("atexit").attr("register")(py::cpp_function([]() {
+        py::gil_scoped_release release;
+        async_pool().shutdown();
+    }));
+
     py::class_<File>(m, "File")
         .def_readonly("id", &File::id)
         .def_readonly("path", &File::path);
@@ -12,7 +206,8 @@ PYBIND11_MODULE(analyzer, m) {
     py::class_<Import>(m, "Import")
         .def_readonly("file_id", &Import::file_id)
         .def_readonly("module", &Import::module)
-        .def_readonly("name", &Import::name);
+        .def_readonly("name", &Import::name)
+        .def_readonly("target_file_id", &Import::target_file_id);
     
     py::class_<DangerousCall>(m, "DangerousCall")
         .def_readonly("function", &DangerousCall::function)
@@ -20,19 +215,263 @@ PYBIND11_MODULE(analyzer, m) {
         .def_readonly("line", &DangerousCall::line)
         .def_readonly("file", &DangerousCall::file);
 
+    py::class_<PathHop>(m, "PathHop")
+        .def_readonly("function", &PathHop::function)
+        .def_readonly("file", &PathHop::file)
+        .def_readonly("line", &PathHop::line);
+
+    py::class_<DangerousPath>(m, "DangerousPath")
+        .def_readonly("sink", &DangerousPath::sink)
+        .def_readonly("entry", &DangerousPath::entry)
+        .def_readonly("hops", &DangerousPath::hops);
+
+    py::class_<DeadSymbol>(m, "DeadSymbol")
+        .def_readonly("kind", &DeadSymbol::kind)
+        .def_readonly("name", &DeadSymbol::name)
+        .def_readonly("file", &DeadSymbol::file)
+        .def_readonly("start_line", &DeadSymbol::start_line)
+        .def_readonly("end_line", &DeadSymbol::end_line);
+
+    py::class_<StringDict, std::shared_ptr<StringDict>>(m, "StringDict")
+        .def("__len__", &StringDict::size)
+        .def("__getitem__", [](const StringDict& d, size_t i) {
+            if (i >= d.values.size()) throw py::index_error();
+            return d.values[i];
+        })
+        .def("to_list", [](const StringDict& d) {
+            py::list out(d.values.size());
+            for (size_t i = 0; i < d.values.size(); i++) out[i] = py::str(d.values[i]);
+            return out;
+        });
+
+    //int32 колонка через buffer protocol: numpy.asarray(col) без копирования
+    py::class_<Column, std::shared_ptr<Column>>(m, "Column", py::buffer_protocol())
+        .def_readonly("name", &Column::name)
+        .def_readonly("dict_encoded", &Column::dict_encoded)
+        .def("__len__", [](const Column& c) { return c.data.size(); })
+        .def_buffer([](Column& c) {
+            return py::buffer_info(
+                c.data.data(), sizeof(int32_t), py::format_descriptor<int32_t>::format(),
+                1, {(py::ssize_t)c.data.size()}, {(py::ssize_t)sizeof(int32_t)}, true);
+        });
+
+    py::class_<ColumnTable>(m, "Table")
+        .def("__len__", &ColumnTable::rows)
+        .def("column", &ColumnTable::column, py::arg("name"))
+        .def("__getitem__", [](const ColumnTable& t, const std::string& name) {
+            auto c = t.column(name);
+            if (!c) throw py::key_error(name);
+            return c;
+        })
+        .def_property_readonly("names", [](const ColumnTable& t) {
+            std::vector<std::string> names;
+            for (const auto& c : t.columns) names.push_back(c->name);
+            return names;
+        })
+        .def_readonly("dictionary", &ColumnTable::dict);
+
+    py::class_<SymbolMatch>(m, "SymbolMatch")
+        .def_readonly("kind", &SymbolMatch::kind)
+        .def_readonly("name", &SymbolMatch::name)
+        .def_readonly("qualified", &SymbolMatch::qualified)
+        .def_readonly("file", &SymbolMatch::file)
+        .def_readonly("line", &SymbolMatch::line)
+        .def_readonly("score", &SymbolMatch::score);
+
+    py::class_<CacheStats>(m, "CacheStats")
+        .def_readonly("hits", &CacheStats::hits)
+        .def_readonly("misses", &CacheStats::misses)
+        .def_readonly("entries", &CacheStats::entries)
+        .def_readonly("version", &CacheStats::version)
+        .def_property_readonly("hit_rate", &CacheStats::hit_rate);
+
+    py::class_<ReportResult>(m, "ReportResult")
+        .def_readonly("kind", &ReportResult::kind)
+        .def_readonly("output", &ReportResult::output)
+        .def_readonly("ok", &ReportResult::ok)
+        .def_readonly("error", &ReportResult::error)
+        .def_readonly("seconds", &ReportResult::seconds);
+
+    py::class_<IndexProgress>(m, "IndexProgress")
+        .def_readonly("stage", &IndexProgress::stage)
+        .def_readonly("done", &IndexProgress::done)
+        .def_readonly("total", &IndexProgress::total)
+        .def_readonly("file", &IndexProgress::file);
+
+    py::class_<Reference>(m, "Reference")
+        .def_readonly("id", &Reference::id)
+        .def_readonly("from_id", &Reference::from_id)
+        .def_readonly("to_id", &Reference::to_id)
+        .def_readonly("kind", &Reference::kind)
+        .def_readonly("args", &Reference::args)
+        .def_readonly("line", &Reference::line);
+
+    bind_cursor<Reference>(m, "RefCursor");
+    bind_cursor<Import>(m, "ImportCursor");
+    bind_cursor<DangerousCall>(m, "DangerousCursor");
+
+    bind_future<std::vector<DangerousCall>>(m, "DangerousFuture");
+    bind_future<std::vector<DangerousPath>>(m, "DangerousPathFuture");
+    bind_future<std::vector<DeadSymbol>>(m, "DeadCodeFuture");
+    bind_future<std::string>(m, "FileFuture");
+
     py::class_<DB, std::shared_ptr<DB>>(m, "DB")
         .def(py::init<const std::string&>())
-        .def("files", &DB::files)
-        .def("add_file", &DB::add_file)
-        .def("create_graph", &DB::create_graph)
-        .def("create_call_graph", &DB::create_call_graph)
-        .def("ents", &DB::ents, py::arg("filename"), py::arg("include_builtin") = true)
-        .def("get_all_imports", &DB::get_all_imports)
-        .def("get_dangerous", &DB::get_dangerous);
+        .def_property_readonly("path", &DB::path)
+        .def("files", [](DB& db, py::kwargs kw) {
+            QueryFilter f = to_filter(kw);
+            py::gil_scoped_release release;
+            return db.files(f);
+        })
+        //на read-only соединении sqlite молча не пишет (query_only), поэтому ошибка явная
+        .def("add_file", [](DB& db, const std::string& path) {
+            if (db.mode() != OpenMode::READ_WRITE) throw std::runtime_error("add_file on a read-only handle: " + db.path());
+            if (!db.add_file(path)) throw std::runtime_error("cannot add file " + path + " to " + db.path());
+        }, py::arg("path"))
+        .def("create_graph", &DB::create_graph, nogil())
+        .def("create_call_graph", &DB::create_call_graph, nogil())
+        .def("create_rollup_graph", &DB::create_rollup_graph, py::arg("level"), py::arg("output_file") = "rollup.dot", nogil())
+        .def("ents", py::overload_cast<const std::string&, bool>(&DB::ents), py::arg("filename"), py::arg("include_builtin") = true, nogil())
+        .def("ents", py::overload_cast<const std::vector<std::string>&, bool, const std::string&>(&DB::ents),
+             py::arg("files"), py::arg("include_builtin") = true, py::arg("output_file") = "", nogil())
+        .def("get_all_imports", [](DB& db, const std::string& save_file, py::kwargs kw) {
+            QueryFilter f = to_filter(kw);
+            py::gil_scoped_release release;
+            return db.get_all_imports(save_file, f);
+        }, py::arg("save_file") = "")
+        .def("create_import_graph", &DB::create_import_graph, py::arg("output_file") = "imports.dot", nogil())
+        .def("import_cycles", &DB::import_cycles, nogil())
+        .def("import_layers", &DB::import_layers, nogil())
+        .def("is_project_module", &DB::is_project_module)
+        .def("get_dangerous", [](DB& db, py::kwargs kw) {
+            QueryFilter f = to_filter(kw);
+            py::gil_scoped_release release;
+            return db.get_dangerous(f);
+        })
+        .def("files_columns", &DB::files_columns, nogil())
+        .def("refs_columns", &DB::refs_columns, nogil())
+        .def("imports_columns", &DB::imports_columns, nogil())
+        .def("dangerous_columns", [](DB& db, py::kwargs kw) {
+            QueryFilter f = to_filter(kw);
+            py::gil_scoped_release release;
+            return db.dangerous_columns(f);
+        })
+        .def("get_dangerous_paths", &DB::get_dangerous_paths, py::arg("entry_patterns"), nogil())
+        .def("dead_code", &DB::dead_code, py::arg("roots") = std::vector<std::string>{}, nogil())
+        .def_property_readonly("write_version", &DB::write_version)
+        .def("cache_stats", &DB::cache_stats)
+        .def("clear_cache", &DB::clear_cache)
+        .def("load_cache", &DB::load_cache, py::arg("path") = "", nogil())
+        .def("save_cache", &DB::save_cache, py::arg("path") = "", nogil())
+        .def("persist_cache", &DB::persist_cache, py::arg("path") = "", nogil())
+        .def("export_snapshot", &DB::export_snapshot, py::arg("path"), nogil())
+        .def("search", &DB::search, py::arg("query"), py::arg("kind") = "", py::arg("limit") = 20, nogil())
+        .def("mro", &DB::mro, py::arg("cls"), nogil())
+        .def("subclasses", &DB::subclasses, py::arg("cls"), nogil())
+        //курсор держит соединение DB живым
+        .def("iter_refs", &DB::iter_refs, py::arg("chunk_size") = 1024, py::keep_alive<0, 1>())
+        .def("iter_imports", &DB::iter_imports, py::arg("chunk_size") = 1024, py::keep_alive<0, 1>())
+        .def("iter_dangerous", [](DB& db, size_t chunk_size, py::kwargs kw) {
+            return db.iter_dangerous(chunk_size, to_filter(kw));
+        }, py::arg("chunk_size") = 1024, py::keep_alive<0, 1>())
+        .def("get_dangerous_async", [](const DB& db) {
+            return run_async(db, [](DB& d) { return d.get_dangerous(); });
+        })
+        .def("get_dangerous_paths_async", [](const DB& db, const std::vector<std::string>& entry_patterns) {
+            return run_async(db, [entry_patterns](DB& d) { return d.get_dangerous_paths(entry_patterns); });
+        }, py::arg("entry_patterns"))
+        .def("dead_code_async", [](const DB& db, const std::vector<std::string>& roots) {
+            return run_async(db, [roots](DB& d) { return d.dead_code(roots); });
+        }, py::arg("roots") = std::vector<std::string>{})
+        .def("create_call_graph_async", [](const DB& db, const std::string& output_file) {
+            return run_async(db, [output_file](DB& d) {
+                if (!d.create_call_graph(output_file)) throw std::runtime_error("cannot write " + output_file);
+                return output_file;
+            });
+        }, py::arg("output_file") = "call_graph.dot")
+        .def("create_graph_async", [](const DB& db, const std::string& output_file) {
+            return run_async(db, [output_file](DB& d) {
+                if (!d.create_graph(output_file)) throw std::runtime_error("cannot write " + output_file);
+                return output_file;
+            });
+        }, py::arg("output_file") = "inheritance.dot")
+        .def("is_subclass", [](DB& db, const std::string& cls, const std::string& base) {
+            int cid = db.get_class_id_by_name(cls);
+            int bid = db.get_class_id_by_name(base);
+            return cid && bid && db.is_subclass(cid, bid);
+        }, py::arg("cls"), py::arg("base"));
 
+    //функции снимка адресуются индексами 0..function_count-1
+    py::class_<Snapshot, std::shared_ptr<Snapshot>>(m, "Snapshot")
+        .def(py::init([](const std::string& path) {
+            auto snap = std::make_shared<Snapshot>(path);
+            if (!snap->ok()) throw std::runtime_error("cannot open snapshot " + path);
+            return snap;
+        }), py::arg("path"))
+        .def_property_readonly("file_count", &Snapshot::file_count)
+        .def_property_readonly("class_count", &Snapshot::class_count)
+        .def_property_readonly("function_count", &Snapshot::function_count)
+        .def("find", [](const Snapshot& s, const std::string& name) { return s.find_functions(name); }, py::arg("name"))
+        .def("index_of", [](const Snapshot& s, int id) -> py::object {
+            uint32_t i = s.function_index(id);
+            return i == SNAP_NONE ? py::object(py::none()) : py::cast(i);
+        }, py::arg("id"))
+        .def("name", [](const Snapshot& s, uint32_t f) { return std::string(s.function_name(f)); }, py::arg("func"))
+        .def("qualified", &Snapshot::qualified, py::arg("func"))
+        .def("id", &Snapshot::function_id, py::arg("func"))
+        .def("file", [](const Snapshot& s, uint32_t f) { return std::string(s.file_path(s.function_file(f))); }, py::arg("func"))
+        .def("line", &Snapshot::function_line, py::arg("func"))
+        .def("callees", [](const Snapshot& s, uint32_t f) {
+            IndexSpan span = s.callees(f);
+            return std::vector<uint32_t>(span.begin(), span.end());
+        }, py::arg("func"))
+        .def("callers", [](const Snapshot& s, uint32_t f) {
+            IndexSpan span = s.callers(f);
+            return std::vector<uint32_t>(span.begin(), span.end());
+        }, py::arg("func"))
+        .def("files", &Snapshot::files, nogil())
+        .def("get_dangerous", &Snapshot::get_dangerous, nogil());
 
+    py::class_<DBPool, std::shared_ptr<DBPool>>(m, "Pool")
+        .def(py::init([](const std::string& path, size_t size, bool immutable) {
+            return std::make_shared<DBPool>(path, size, immutable ? OpenMode::IMMUTABLE : OpenMode::READ_ONLY);
+        }), py::arg("path"), py::arg("size") = 4, py::arg("immutable") = false)
+        .def("acquire", &DBPool::acquire, py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("size", &DBPool::size);
 
-    m.def("open", [](const std::string& path) {
-        return std::make_shared<DB>(path);
-    });
+    //по умолчанию read-write, как до появления режимов; для отчетов - read_only=True или immutable=True
+    m.def("open", [](const std::string& path, bool read_only, bool immutable) {
+        OpenMode mode = immutable ? OpenMode::IMMUTABLE : (read_only ? OpenMode::READ_ONLY : OpenMode::READ_WRITE);
+        return std::make_shared<DB>(path, mode);
+    }, py::arg("path"), py::arg("read_only") = false, py::arg("immutable") = false);
+
+    //индексация в текущем интерпретаторе, GIL берется только на обход ast и вызов progress
+    m.def("index", [](const std::string& path, std::string db_path, int jobs, py::object progress) {
+        if (db_path.empty()) db_path = std::filesystem::path(path).filename().string() + ".myund";
+
+        //исключение из callback не пробрасывается через C++, поднимается после индексации
+        std::unique_ptr<py::error_already_set> callback_error;
+        ProgressFn fn;
+        if (!progress.is_none()) {
+            fn = [&](const IndexProgress& p) {
+                py::gil_scoped_acquire acquire;
+                if (callback_error) return;
+                try { progress(p); }
+                catch (py::error_already_set& e) { callback_error = std::make_unique<py::error_already_set>(std::move(e)); }
+            };
+        }
+
+        bool ok;
+        {
+            py::gil_scoped_release release;
+            ok = index_project(path, db_path, jobs, fn);
+        }
+        if (callback_error) throw std::move(*callback_error);
+        if (!ok) throw std::runtime_error("failed to index " + path);
+        return db_path;
+    }, py::arg("path"), py::arg("db_path") = "", py::arg("jobs") = 1, py::arg("progress") = py::none());
+
+    m.def("report", [](const std::string& db_path, const std::string& spec, int jobs) {
+        return run_report(db_path, parse_report_spec(spec), jobs);
+    }, py::arg("db_path"), py::arg("spec"), py::arg("jobs") = 0, nogil());
 }
@@ -0,0 +1,273 @@
+#include "capture.h"
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+
+static const size_t VALUE_MAX = 60;
+static const int DEPTH_MAX = 2;
+static const Py_ssize_t ITEMS_MAX = 8;
+
+using Clock = std::chrono::steady_clock;
+
+bool parse_arg_capture(const std::string& name, ArgCapture& mode) {
+    if (name == "none") mode = ArgCapture::NONE;
+    else if (name == "types") mode = ArgCapture::TYPES;
+    else if (name == "shallow") mode = ArgCapture::SHALLOW;
+    else if (name == "full") mode = ArgCapture::FULL;
+    else return false;
+    return true;
+}
+
+//значение с ограничением длины: форматтер останавливается, как только строка заполнена
+struct BoundedOut {
+    std::string s;
+    Clock::time_point deadline;
+    bool full = false;
+
+    bool put(const char* p, size_t n) {
+        if (full) return false;
+        if (s.size() + n > VALUE_MAX) {
+            s.append(p, VALUE_MAX + 1 - s.size() < n ? VALUE_MAX + 1 - s.size() : n);
+            full = true;
+            return false;
+        }
+        s.append(p, n);
+        return true;
+    }
+    bool put(const char* p) { return put(p, strlen(p)); }
+    bool put(const std::string& p) { return put(p.data(), p.size()); }
+    bool late() const { return Clock::now() > deadline; }
+};
+
+static void put_char(BoundedOut& out, uint32_t c, char quote) {
+    char buf[8];
+    if (c == '\\' || c == (uint32_t)quote) {
+        buf[0] = '\\';
+        buf[1] = (char)c;
+        out.put(buf, 2);
+    } else if (c == '\n') {
+        out.put("\\n", 2);
+    } else if (c == '\r') {
+        out.put("\\r", 2);
+    } else if (c == '\t') {
+        out.put("\\t", 2);
+    } else if (c < 0x20 || c == 0x7f) {
+        snprintf(buf, sizeof(buf), "\\x%02x", c);
+        out.put(buf);
+    } else if (c < 0x80) {
+        buf[0] = (char)c;
+        out.put(buf, 1);
+    } else if (c < 0x800) {
+        buf[0] = (char)(0xC0 | (c >> 6));
+        buf[1] = (char)(0x80 | (c & 0x3F));
+        out.put(buf, 2);
+    } else if (c < 0x10000) {
+        buf[0] = (char)(0xE0 | (c >> 12));
+        buf[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        buf[2] = (char)(0x80 | (c & 0x3F));
+        out.put(buf, 3);
+    } else {
+        buf[0] = (char)(0xF0 | (c >> 18));
+        buf[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+        buf[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+        buf[3] = (char)(0x80 | (c & 0x3F));
+        out.put(buf, 4);
+    }
+}
+
+static void put_str(BoundedOut& out, PyObject* v) {
+    Py_ssize_t len = PyUnicode_GET_LENGTH(v);
+    int kind = PyUnicode_KIND(v);
+    const void* data = PyUnicode_DATA(v);
+    out.put("'", 1);
+    for (Py_ssize_t i = 0; i < len && !out.full; i++) put_char(out, PyUnicode_READ(kind, data, i), '\'');
+    out.put("'", 1);
+}
+
+static void put_bytes(BoundedOut& out, const char* data, Py_ssize_t len) {
+    out.put("b'", 2);
+    for (Py_ssize_t i = 0; i < len && !out.full; i++) {
+        unsigned char c = (unsigned char)data[i];
+        if (c >= 0x80) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\x%02x", c);
+            out.put(buf);
+        } else {
+            put_char(out, c, '\'');
+        }
+    }
+    out.put("'", 1);
+}
+
+//имя типа и длина; длина только у C-типов, у классов на Python len() - пользовательский __len__
+static void put_type(std::string& out, PyObject* v) {
+    PyTypeObject* type = Py_TYPE(v);
+    out += type->tp_name;
+    if (type->tp_flags & Py_TPFLAGS_HEAPTYPE) return;
+
+    lenfunc len = nullptr;
+    if (type->tp_as_sequence && type->tp_as_sequence->sq_length) len = type->tp_as_sequence->sq_length;
+    else if (type->tp_as_mapping && type->tp_as_mapping->mp_length) len = type->tp_as_mapping->mp_length;
+    if (!len) return;
+    Py_ssize_t n = len(v);
+    if (n >= 0) out += " len=" + std::to_string(n);
+    else PyErr_Clear();
+}
+
+static void put_shallow(BoundedOut& out, PyObject* v, int depth);
+
+//элементы контейнера через запятую, не больше ITEMS_MAX
+template <typename Next>
+static void put_items(BoundedOut& out, Py_ssize_t size, int depth, Next next) {
+    for (Py_ssize_t i = 0; i < size && !out.full; i++) {
+        if (i) out.put(", ", 2);
+        if (i == ITEMS_MAX || out.late()) {
+            out.put("...", 3);
+            return;
+        }
+        next(i, depth + 1);
+    }
+}
+
+static void put_shallow(BoundedOut& out, PyObject* v, int depth) {
+    if (v == Py_None) {
+        out.put("None");
+    } else if (PyBool_Check(v)) {
+        out.put(v == Py_True ? "True" : "False");
+    } else if (PyLong_Check(v)) {
+        int overflow = 0;
+        long long x = PyLong_AsLongLongAndOverflow(v, &overflow);
+        if (overflow || (x == -1 && PyErr_Occurred())) {
+            PyErr_Clear();
+            out.put("<big int>");
+        } else {
+            out.put(std::to_string(x));
+        }
+    } else if (PyFloat_Check(v)) {
+        char* r = PyOS_double_to_string(PyFloat_AS_DOUBLE(v), 'r', 0, Py_DTSF_ADD_DOT_0, nullptr);
+        if (r) {
+            out.put(r);
+            PyMem_Free(r);
+        }
+    } else if (PyUnicode_Check(v)) {
+        put_str(out, v);
+    } else if (PyBytes_Check(v)) {
+        put_bytes(out, PyBytes_AS_STRING(v), PyBytes_GET_SIZE(v));
+    } else if (depth >= DEPTH_MAX && (PyList_CheckExact(v) || PyTuple_CheckExact(v) || PyDict_CheckExact(v) || PyAnySet_CheckExact(v))) {
+        std::string t;
+        put_type(t, v);
+        out.put("<" + t + ">");
+    } else if (PyList_CheckExact(v)) {
+        out.put("[", 1);
+        put_items(out, PyList_GET_SIZE(v), depth, [&](Py_ssize_t i, int d) { put_shallow(out, PyList_GET_ITEM(v, i), d); });
+        out.put("]", 1);
+    } else if (PyTuple_CheckExact(v)) {
+        out.put("(", 1);
+        put_items(out, PyTuple_GET_SIZE(v), depth, [&](Py_ssize_t i, int d) { put_shallow(out, PyTuple_GET_ITEM(v, i), d); });
+        out.put(PyTuple_GET_SIZE(v) == 1 ? ",)" : ")");
+    } else if (PyDict_CheckExact(v)) {
+        out.put("{", 1);
+        Py_ssize_t pos = 0;
+        PyObject* key;
+        PyObject* value;
+        put_items(out, PyDict_GET_SIZE(v), depth, [&](Py_ssize_t, int d) {
+            if (!PyDict_Next(v, &pos, &key, &value)) return;
+            put_shallow(out, key, d);
+            out.put(": ", 2);
+            put_shallow(out, value, d);
+        });
+        out.put("}", 1);
+    } else if (PyAnySet_CheckExact(v)) {
+        if (PySet_GET_SIZE(v) == 0) {
+            out.put(PyFrozenSet_CheckExact(v) ? "frozenset()" : "set()");
+            return;
+        }
+        if (PyFrozenSet_CheckExact(v)) out.put("frozenset(");
+        out.put("{", 1);
+        PyObject* it = PyObject_GetIter(v);
+        put_items(out, it ? PySet_GET_SIZE(v) : 0, depth, [&](Py_ssize_t, int d) {
+            PyObject* item = PyIter_Next(it);
+            if (!item) return;
+            put_shallow(out, item, d);
+            Py_DECREF(item);
+        });
+        Py_XDECREF(it);
+        out.put("}", 1);
+        if (PyFrozenSet_CheckExact(v)) out.put(")", 1);
+    } else {
+        std::string t;
+        put_type(t, v);
+        out.put("<" + t + ">");
+    }
+}
+
+static std::string format_value(PyObject* v, ArgCapture mode, Clock::time_point deadline) {
+    std::string value_str;
+    if (mode == ArgCapture::TYPES) {
+        put_type(value_str, v);
+    } else if (mode == ArgCapture::FULL) {
+        PyObject* repr = PyObject_Repr(v);
+        if (repr) {
+            const char* repr_c = PyUnicode_AsUTF8(repr);
+            value_str = repr_c ? std::string(repr_c) : "<repr?>";
+            Py_DECREF(repr);
+        } else {
+            value_str = "<repr-error>";
+        }
+    } else {
+        BoundedOut out;
+        out.deadline = deadline;
+        put_shallow(out, v, 0);
+        value_str = std::move(out.s);
+    }
+    if (value_str.length() > VALUE_MAX) {
+        value_str = value_str.substr(0, VALUE_MAX - 3) + "...";
+    }
+    PyErr_Clear();
+    return value_str;
+}
+
+void capture_args(PyFrameObject* frame, const std::vector<std::string>& names, const CaptureOptions& options, std::string& out) {
+    if (options.mode == ArgCapture::NONE || names.empty()) return;
+
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::microseconds(options.time_us);
+    size_t used = 0;
+    ArgCapture mode = options.mode;
+
+#if PY_VERSION_HEX < 0x030C0000
+    PyObject* locals = PyFrame_GetLocals(frame);
+    if (!locals) {
+        PyErr_Clear();
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < names.size(); i++) {
+        if (used >= options.bytes) {
+            out += "<budget: " + std::to_string(names.size() - i) + " more>\n";
+            break;
+        }
+        //время вышло - остальные аргументы только типами
+        if (mode != ArgCapture::TYPES && Clock::now() > deadline) mode = ArgCapture::TYPES;
+
+#if PY_VERSION_HEX >= 0x030C0000
+        PyObject* value = PyFrame_GetVarString(frame, names[i].c_str());
+#else
+        PyObject* value = PyMapping_GetItemString(locals, names[i].c_str());
+#endif
+        if (!value) {
+            PyErr_Clear();
+            continue;
+        }
+
+        std::string line = names[i] + ": " + format_value(value, mode, deadline) + "\n";
+        Py_DECREF(value);
+        used += line.size();
+        out += line;
+    }
+
+#if PY_VERSION_HEX < 0x030C0000
+    Py_DECREF(locals);
+#endif
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <Python.h>
+#include <frameobject.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//что писать об аргументах хукнутого вызова
+enum class ArgCapture {
+    NONE,
+    TYPES,      //имя типа и длина встроенных контейнеров
+    SHALLOW,    //свой форматтер для встроенных типов, пользовательский __repr__ не вызывается
+    FULL        //repr()
+};
+
+struct CaptureOptions {
+    ArgCapture mode = ArgCapture::SHALLOW;
+    size_t bytes = 1024;        //на один вызов, дальше <budget>
+    uint64_t time_us = 200;     //на один вызов, дальше только типы
+};
+
+bool parse_arg_capture(const std::string& name, ArgCapture& mode);
+
+//аргументы строками "name: value\n", каждое значение не длиннее 60 символов
+void capture_args(PyFrameObject* frame, const std::vector<std::string>& names, const CaptureOptions& options, std::string& out);
@@ -8,55 +8,242 @@
 #include <set>
 #include <algorithm>
 #include <cstring>
+#include <deque>
+#include <cstdint>
+#include <sstream>
+#include <functional>
+#include <unordered_map>
+#include <fnmatch.h>
+#include <filesystem>
+#include <typeinfo>
+#include <sys/stat.h>
+
+
+
+DB::DB(const std::string& path) : DB(path, OpenMode::READ_WRITE) {}
+
+//путь в uri вида file:..., спецсимволы кодируются
+static std::string path_to_uri(const std::string& path) {
+    std::string out = "file:";
+    for (char c : path) {
+        if (c == '?' || c == '#' || c == '%') {
+            char buf[4];
+            snprintf(buf, sizeof(buf), "%%%02X", (unsigned char)c);
+            out += buf;
+        } else {
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
+static bool has_column(sqlite3* conn, const char* table, const char* column) {
+    sqlite3_stmt* stmt = nullptr;
+    bool found = false;
+    if (sqlite3_prepare_v2(conn, "SELECT 1 FROM pragma_table_info(?) WHERE name = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, table, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, column, -1, SQLITE_STATIC);
+        found = sqlite3_step(stmt) == SQLITE_ROW;
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
 
+//колонки, добавленные после первой версии схемы; CREATE TABLE IF NOT EXISTS старую таблицу не меняет
+static const struct { const char* table; const char* column; const char* type; } ADDED_COLUMNS[] = {
+    {"classes", "bases", "TEXT"},
+    {"functions", "decorators", "TEXT"},
+    {"refs", "line", "INTEGER"},
+    {"refs", "file_id", "INTEGER"},
+    {"imports", "target_file_id", "INTEGER"},
+};
+static const int SCHEMA_VERSION = 2;
+
+bool upgrade_schema(sqlite3* conn) {
+    sqlite3_stmt* stmt = nullptr;
+    int version = 0;
+    if (sqlite3_prepare_v2(conn, "SELECT value FROM meta WHERE key = 'schema_version';", -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if (version >= SCHEMA_VERSION) return true;
+
+    for (const auto& c : ADDED_COLUMNS) {
+        //таблицы еще нет - ее создаст create_project_db уже с колонкой
+        if (!has_column(conn, c.table, "id") || has_column(conn, c.table, c.column)) continue;
+        std::string sql = std::string("ALTER TABLE ") + c.table + " ADD COLUMN " + c.column + " " + c.type + ";";
+        char* err_msg = nullptr;
+        if (sqlite3_exec(conn, sql.c_str(), nullptr, nullptr, &err_msg) != SQLITE_OK) {
+            std::cerr << "SQL error: " << (err_msg ? err_msg : "") << std::endl;
+            sqlite3_free(err_msg);
+            return false;
+        }
+    }
+    std::string sql = "INSERT OR REPLACE INTO meta(key, value) VALUES('schema_version', " + std::to_string(SCHEMA_VERSION) + ");";
+    return sqlite3_exec(conn, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+}
 
+DB::DB(const std::string& path, OpenMode mode) : db_path(path), open_mode(mode) {
+    std::string uri = path;
+    int flags = SQLITE_OPEN_URI;
+    if (mode == OpenMode::READ_WRITE) {
+        flags |= SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    } else {
+        flags |= SQLITE_OPEN_READONLY;
+        uri = path_to_uri(path) + (mode == OpenMode::IMMUTABLE ? "?immutable=1" : "");
+    }
 
-DB::DB(const std::string& path) {
-    if (sqlite3_open(path.c_str(), &conn)) {
+    if (sqlite3_open_v2(uri.c_str(), &conn, flags, nullptr) != SQLITE_OK) {
         std::cerr << "Cannot open database: " << sqlite3_errmsg(conn) << std::endl;
+        sqlite3_close(conn);
         conn = nullptr;
+        return;
+    }
+
+    sqlite3_busy_timeout(conn, 5000);
+
+    //64мб кэша страниц, временные таблицы в памяти, 256мб mmap
+    const char* common =
+        "PRAGMA cache_size=-65536;"
+        "PRAGMA temp_store=MEMORY;"
+        "PRAGMA mmap_size=268435456;";
+    sqlite3_exec(conn, common, nullptr, nullptr, nullptr);
+
+    if (mode == OpenMode::READ_WRITE) {
+        sqlite3_exec(conn, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", nullptr, nullptr, nullptr);
+        //счетчик записей для кэша результатов, в старых БД таблицы еще нет
+        sqlite3_exec(conn,
+            "CREATE TABLE IF NOT EXISTS meta(key TEXT PRIMARY KEY, value INTEGER);"
+            "INSERT OR IGNORE INTO meta(key, value) VALUES('write_version', 0);"
+            "INSERT OR IGNORE INTO meta(key, value) VALUES('generation', random());", nullptr, nullptr, nullptr);
+        upgrade_schema(conn);
+    } else {
+        sqlite3_exec(conn, "PRAGMA query_only=1;", nullptr, nullptr, nullptr);
+    }
+}
+
+//условия WHERE и параметры к ним, биндятся по порядку
+struct SqlWhere {
+    struct Param { bool is_int; int i; std::string s; };
+    std::vector<std::string> clauses;
+    std::vector<Param> params;
+
+    void text(const std::string& clause, const std::string& v) { clauses.push_back(clause); params.push_back({false, 0, v}); }
+    void integer(const std::string& clause, int v) { clauses.push_back(clause); params.push_back({true, v, ""}); }
+
+    std::string sql(const std::string& base_where = "") const {
+        std::string out;
+        if (!base_where.empty()) out = base_where;
+        for (const auto& c : clauses) out += (out.empty() ? "" : " AND ") + c;
+        return out.empty() ? "" : " WHERE " + out;
+    }
+
+    void bind(sqlite3_stmt* stmt, int start = 1) const {
+        for (size_t i = 0; i < params.size(); i++) {
+            if (params[i].is_int) sqlite3_bind_int(stmt, start + (int)i, params[i].i);
+            else sqlite3_bind_text(stmt, start + (int)i, params[i].s.c_str(), -1, SQLITE_TRANSIENT);
+        }
+    }
+};
+
+//префикс -> GLOB шаблон, спецсимволы экранируются классами [*]
+static std::string glob_prefix(const std::string& prefix) {
+    std::string out;
+    for (char c : prefix) {
+        if (c == '*' || c == '?' || c == '[') { out += '['; out += c; out += ']'; }
+        else out += c;
+    }
+    return out + "*";
+}
+
+//GLOB по префиксу использует индекс по колонке
+static void add_path_filter(SqlWhere& w, const QueryFilter& f, const std::string& path_col, const std::string& file_id_col) {
+    if (!f.path_prefix.empty()) w.text(path_col + " GLOB ?", glob_prefix(f.path_prefix));
+    if (!f.path_glob.empty()) w.text(path_col + " GLOB ?", f.path_glob);
+    if (!f.file_ids.empty()) {
+        std::string in = file_id_col + " IN (";
+        for (size_t i = 0; i < f.file_ids.size(); i++) in += i ? ",?" : "?";
+        in += ")";
+        w.clauses.push_back(in);
+        for (int id : f.file_ids) w.params.push_back({true, id, ""});
     }
 }
 
+static std::string limit_sql(const QueryFilter& f) {
+    if (f.limit < 0 && f.offset <= 0) return "";
+    return " LIMIT " + std::to_string(f.limit) + " OFFSET " + std::to_string(std::max(f.offset, 0));
+}
+
+//ключ кэша для фильтра
+static std::string filter_key(const QueryFilter& f) {
+    std::string key = "|" + f.path_prefix + "|" + f.path_glob + "|" + f.module_prefix + "|";
+    for (int id : f.file_ids) key += std::to_string(id) + ",";
+    key += "|";
+    for (const auto& s : f.sinks) key += s + ",";
+    key += "|" + std::to_string(f.line_min) + "|" + std::to_string(f.line_max) + "|" + std::to_string(f.limit) + "|" + std::to_string(f.offset);
+    return key;
+}
+
+static std::string list_key(const std::vector<std::string>& items) {
+    std::string key;
+    for (const auto& s : items) key += "|" + s;
+    return key;
+}
+
 DB::~DB() {
-    if (conn) sqlite3_close(conn);
+    if (!cache_file.empty()) save_cache(cache_file);
+    if (conn) sqlite3_close_v2(conn);
 }
 
-void DB::add_file(const std::string& path) {
-    if (!conn) return;
+//шаг подготовленного insert, ошибка prepare или step - false с сообщением
+static bool insert_done(sqlite3* conn, sqlite3_stmt* stmt) {
+    bool ok = stmt && sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) std::cerr << "fail to insert: " << sqlite3_errmsg(conn) << "\n";
+    sqlite3_finalize(stmt);
+    return ok;
+}
+
+bool DB::add_file(const std::string& path) {
+    if (!conn) return false;
     sqlite3_stmt* stmt;
     std::string sql = "INSERT INTO files(path) VALUES(?);";
     sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr);
     sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_STATIC);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    if (!insert_done(conn, stmt)) return false;
+    touch();
+    return true;
 }
 
-void DB::add_class(const std::string& name, int file_id, int start_line, int end_line) {
-    if (!conn) return;
+bool DB::add_class(const std::string& name, int file_id, int start_line, int end_line, const std::string& bases) {
+    if (!conn) return false;
     sqlite3_stmt* stmt;
-    std::string sql = "INSERT INTO classes(name,file_id,start_line,end_line) VALUES(?,?,?,?);";
+    std::string sql = "INSERT INTO classes(name,file_id,start_line,end_line,bases) VALUES(?,?,?,?,?);";
     sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr);
     sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 2, file_id);
     sqlite3_bind_int(stmt, 3, start_line);
     sqlite3_bind_int(stmt, 4, end_line);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    sqlite3_bind_text(stmt, 5, bases.c_str(), -1, SQLITE_STATIC);
+    if (!insert_done(conn, stmt)) return false;
+    touch();
+    return true;
 }
 
-void DB::add_function(
+bool DB::add_function(
     const std::string& name,
     int file_id,
     int class_id,
     int start_line,
     int end_line,
-    const std::string& args
+    const std::string& args,
+    const std::string& decorators
 ) {
+    if (!conn) return false;
     sqlite3_stmt* stmt;
     const char* sql =
-        "INSERT INTO functions(name, file_id, class_id, start_line, end_line, args) "
-        "VALUES (?, ?, ?, ?, ?, ?)";
+        "INSERT INTO functions(name, file_id, class_id, start_line, end_line, args, decorators) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?)";
 
     sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr);
     sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_TRANSIENT);
@@ -65,39 +252,54 @@ void DB::add_function(
     sqlite3_bind_int(stmt, 4, start_line);
     sqlite3_bind_int(stmt, 5, end_line);
     sqlite3_bind_text(stmt, 6, args.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 7, decorators.c_str(), -1, SQLITE_TRANSIENT);
 
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    if (!insert_done(conn, stmt)) return false;
+    touch();
+    return true;
 }
 
 
-void DB::add_reference(int from_id, int to_id,
+bool DB::add_reference(int from_id, int to_id,
                        const std::string& kind,
-                       const std::string& args)
+                       const std::string& args,
+                       int line,
+                       int file_id)
 {
+    if (!conn) return false;
     sqlite3_stmt* stmt;
     const char* sql =
-        "INSERT INTO refs(from_id, to_id, kind, args) VALUES (?, ?, ?, ?)";
+        "INSERT INTO refs(from_id, to_id, kind, args, line, file_id) VALUES (?, ?, ?, ?, ?, ?)";
 
     sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr);
     sqlite3_bind_int(stmt, 1, from_id);
     sqlite3_bind_int(stmt, 2, to_id);
     sqlite3_bind_text(stmt, 3, kind.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_text(stmt, 4, args.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 5, line);
+    sqlite3_bind_int(stmt, 6, file_id);
 
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    if (!insert_done(conn, stmt)) return false;
+    touch();
+    return true;
 }
 
 
 
-std::vector<File> DB::files() {
+std::vector<File> DB::files(const QueryFilter& filter) {
+    std::string cache_key = "files" + filter_key(filter);
+    if (auto hit = cache_get<std::vector<File>>(cache_key)) return *hit;
+
     std::vector<File> result;
     if (!conn) return result;
 
+    SqlWhere where;
+    add_path_filter(where, filter, "path", "id");
+
     sqlite3_stmt* stmt;
-    std::string sql = "SELECT id, path FROM files;";
+    std::string sql = "SELECT id, path FROM files" + where.sql() + " ORDER BY id" + limit_sql(filter) + ";";
     if (sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        where.bind(stmt);
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             File f;
             f.id = sqlite3_column_int(stmt, 0);
@@ -106,13 +308,96 @@ std::vector<File> DB::files() {
         }
     }
     sqlite3_finalize(stmt);
-    return result;
+    return cache_put(cache_key, result);
 }
 
 int DB::last_insert_id() {
     return (conn) ? (int)sqlite3_last_insert_rowid(conn) : 0;
 }
 
+//пакетная запись одной транзакцией
+void DB::begin() {
+    if (conn) sqlite3_exec(conn, "BEGIN;", nullptr, nullptr, nullptr);
+}
+
+void DB::commit() {
+    if (!conn) return;
+    if (version_dirty) bump_version();
+    sqlite3_exec(conn, "COMMIT;", nullptr, nullptr, nullptr);
+}
+
+//вне транзакции версия растет сразу, внутри - один раз при commit
+void DB::touch() {
+    if (!conn) return;
+    if (sqlite3_get_autocommit(conn)) bump_version();
+    else version_dirty = true;
+}
+
+//savepoint работает и внутри транзакции вызывающего, и без нее (тогда release = commit)
+bool DB::savepoint(const char* name) {
+    if (!conn) return false;
+    std::string sql = std::string("SAVEPOINT ") + name + ";";
+    char* err_msg = nullptr;
+    if (sqlite3_exec(conn, sql.c_str(), nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cerr << "SQL error: " << (err_msg ? err_msg : "") << std::endl;
+        sqlite3_free(err_msg);
+        return false;
+    }
+    return true;
+}
+
+//keep = false откатывает все после savepoint, транзакция вызывающего остается
+bool DB::release(const char* name, bool keep) {
+    if (!conn) return false;
+    std::string sql = keep ? std::string("RELEASE ") + name + ";"
+                           : std::string("ROLLBACK TO ") + name + "; RELEASE " + name + ";";
+    bool ok = sqlite3_exec(conn, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+    //внешний savepoint закоммитил или откатил все сам
+    if (sqlite3_get_autocommit(conn)) {
+        if (keep && ok && version_dirty) bump_version();
+        version_dirty = false;
+    }
+    return ok && keep;
+}
+
+void DB::bump_version() {
+    version_dirty = false;
+    sqlite3_exec(conn, "UPDATE meta SET value = value + 1 WHERE key = 'write_version';", nullptr, nullptr, nullptr);
+}
+
+void DB::rollback() {
+    if (!conn) return;
+    sqlite3_exec(conn, "ROLLBACK;", nullptr, nullptr, nullptr);
+    version_dirty = false;
+    //иерархия и индекс модулей могли загрузиться из откаченных данных
+    std::lock_guard<std::mutex> lock(cache_mtx);
+    hierarchy_loaded = false;
+    module_index_loaded = false;
+}
+
+//очистка перед переиндексацией, схема остается; внутри транзакции откатывается вместе с ней
+bool DB::clear() {
+    if (!conn || !savepoint("clear")) return false;
+    char* err_msg = nullptr;
+    const char* sql =
+        "DELETE FROM files; DELETE FROM classes; DELETE FROM class_mro; DELETE FROM class_tree; "
+        "DELETE FROM functions; DELETE FROM refs; DELETE FROM imports; DELETE FROM exports;";
+    bool ok = sqlite3_exec(conn, sql, nullptr, nullptr, &err_msg) == SQLITE_OK;
+    if (!ok) {
+        std::cerr << "SQL error: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+    }
+    touch();
+    ok = release("clear", ok);
+    std::lock_guard<std::mutex> lock(cache_mtx);
+    hierarchy_loaded = false;
+    module_index_loaded = false;
+    module_index.clear();
+    file_modules.clear();
+    package_files.clear();
+    return ok;
+}
+
 int DB::get_class_id_by_name(const std::string& class_name) {
     sqlite3_stmt* stmt;
     std::string sql = "SELECT id FROM classes WHERE name=? LIMIT 1;";
@@ -156,7 +441,13 @@ int DB::get_function_id_by_name_class(const std::string& func_name, int class_id
     return id;
 }
 
-void DB::create_graph(const std::string& output_file) {
+bool DB::create_graph(const std::string& output_file) {
+    std::string cache_key = "create_graph|" + output_file;
+    if (export_cached(cache_key, output_file)) {
+        std::cout << ".dot created: " << output_file << "\n";
+        return true;
+    }
+
     std::vector<ClassNode> classes;
     std::vector<ClassEdge> edges;
 
@@ -164,7 +455,7 @@ void DB::create_graph(const std::string& output_file) {
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(conn, sql_classes, -1, &stmt, nullptr) != SQLITE_OK) {
         std::cerr << "fail to prepare statement: " << sqlite3_errmsg(conn) << "\n";
-        return;
+        return false;
     }
     while (sqlite3_step(stmt) == SQLITE_ROW) {
         int id = sqlite3_column_int(stmt, 0);
@@ -178,7 +469,7 @@ void DB::create_graph(const std::string& output_file) {
     const char* sql_refs = "SELECT from_id, to_id FROM refs WHERE kind='inherit';";
     if (sqlite3_prepare_v2(conn, sql_refs, -1, &stmt, nullptr) != SQLITE_OK) {
         std::cerr << "fail to prepare statement: " << sqlite3_errmsg(conn) << "\n";
-        return;
+        return false;
     }
     while (sqlite3_step(stmt) == SQLITE_ROW) {
         int from = sqlite3_column_int(stmt, 0);
@@ -191,7 +482,7 @@ void DB::create_graph(const std::string& output_file) {
     std::ofstream ofs(output_file);
     if (!ofs.is_open()) {
         std::cerr << "fail to open file: " << output_file << "\n";
-        return;
+        return false;
     }
 
     ofs << "digraph InheritanceGraph {\n";
@@ -207,11 +498,32 @@ void DB::create_graph(const std::string& output_file) {
 
     ofs << "}\n";
     ofs.close();
+    if (!ofs) {
+        std::cerr << "fail to write file: " << output_file << "\n";
+        return false;
+    }
 
     std::cout << ".dot created: " << output_file << "\n";
+
+    export_done(cache_key, output_file);
+    return true;
+}
+
+//строка в кавычках для dot: \n - перенос, прочие управляющие символы отбрасываются
+static std::string escape_dot(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') { out.push_back('\\'); out.push_back(c); }
+        else if (c == '\n') out += "\\n";
+        else if ((unsigned char)c >= 0x20) out.push_back(c);
+    }
+    return out;
 }
 
-void DB::create_call_graph(const std::string& output_file) {
+bool DB::create_call_graph(const std::string& output_file) {
+    std::string cache_key = "create_call_graph|" + output_file;
+    if (export_cached(cache_key, output_file)) return true;
+
     struct Node { int id; std::string name; int class_id; bool builtin; };
     struct Edge { int from; int to; std::string args; bool builtin; };
 
@@ -258,14 +570,6 @@ void DB::create_call_graph(const std::string& output_file) {
     //group by class
     std::map<int, std::vector<int>> by_class;
     for (auto &n : nodes) by_class[n.class_id].push_back(n.id);
-    auto escape_dot = [](const std::string &s) {
-        std::string out;
-        for (char c : s) {
-            if (c == '"' || c == '\\') out.push_back('\\');
-            out.push_back(c);
-        }
-        return out;
-    };
     auto truncate = [](const std::string &s, size_t max_len=48) {
         if (s.size() <= max_len) return s;
         return s.substr(0, max_len-3) + std::string("...");
@@ -277,7 +581,7 @@ void DB::create_call_graph(const std::string& output_file) {
     std::ofstream ofs(dot_file);
     if (!ofs.is_open()) {
         fprintf(stderr, "cant open %s\n", dot_file.c_str());
-        return;
+        return false;
     }
 
     ofs << "digraph G {\n";
@@ -333,226 +637,307 @@ void DB::create_call_graph(const std::string& output_file) {
 
     ofs << "}\n";
     ofs.close();
-}
-
-void DB::ents(const std::string& filename, bool include_builtin) {
-    
-
-    sqlite3_stmt* stmt;
-
-    std::map<int, FuncInfo> all_funcs;
-
-    const char* sql_all_funcs =
-        "SELECT f.id, f.name, c.name "
-        "FROM functions f "
-        "LEFT JOIN classes c ON f.class_id = c.id;";
-
-    if (sqlite3_prepare_v2(conn, sql_all_funcs, -1, &stmt, nullptr) == SQLITE_OK) {
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            int fid = sqlite3_column_int(stmt, 0);
-
-            const char* fname = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-            const char* cname = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-
-            all_funcs[fid] = {
-                fname ? fname : "<unnamed>",
-                cname ? cname : ""
-            };
-        }
+    if (!ofs) {
+        std::cerr << "fail to write file: " << output_file << "\n";
+        return false;
     }
-    sqlite3_finalize(stmt);
-
 
+    export_done(cache_key, output_file);
+    return true;
+}
 
-    int file_id = 0;
-    std::string full_path;
+//буферизованный вывод отчета прямо из sqlite3_column_text, без промежуточных std::string
+struct ReportWriter {
+    FILE* out;
+    std::string buf;
 
-    const char* sql_file = "SELECT id, path FROM files WHERE path LIKE '%' || ?;";
+    explicit ReportWriter(FILE* f) : out(f) { buf.reserve(1 << 16); }
+    ~ReportWriter() { flush(); }
 
-    if (sqlite3_prepare_v2(conn, sql_file, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, filename.c_str(), -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            file_id = sqlite3_column_int(stmt, 0);
-            full_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        }
+    ReportWriter& operator<<(const char* s) { if (s) buf.append(s); return spill(); }
+    ReportWriter& operator<<(char c) { buf.push_back(c); return spill(); }
+    ReportWriter& operator<<(int v) {
+        char tmp[16];
+        buf.append(tmp, snprintf(tmp, sizeof(tmp), "%d", v));
+        return spill();
     }
-    sqlite3_finalize(stmt);
-
-    if (!file_id) {
-        fprintf(stderr, "File not found: %s\n", filename.c_str());
-        return;
+    //текстовая колонка без копирования
+    ReportWriter& column(sqlite3_stmt* stmt, int col) {
+        const unsigned char* t = sqlite3_column_text(stmt, col);
+        if (t) buf.append(reinterpret_cast<const char*>(t), sqlite3_column_bytes(stmt, col));
+        return spill();
     }
+    //class.name или name
+    ReportWriter& qualified(sqlite3_stmt* stmt, int class_col, int name_col) {
+        if (sqlite3_column_type(stmt, class_col) != SQLITE_NULL) column(stmt, class_col) << '.';
+        return column(stmt, name_col);
+    }
+    ReportWriter& spill() {
+        if (buf.size() >= (1 << 16)) flush();
+        return *this;
+    }
+    void flush() {
+        if (out && !buf.empty()) fwrite(buf.data(), 1, buf.size(), out);
+        buf.clear();
+    }
+};
 
-    std::ofstream ofs(filename + ".ents.txt");
-    ofs << "FILE: " << full_path << "\n";
-    ofs << "===\n\n";
-
-
-    ofs << "[CLASSES]\n";
-
-    const char* sql_classes =
-        "SELECT name, start_line, end_line "
-        "FROM classes WHERE file_id = ?;";
+//* и ? не переходят через / (dir/*.py - без подкаталогов), в шаблоне с ** - переходят
+static bool path_glob(const std::string& pat, const char* path) {
+    return fnmatch(pat.c_str(), path, pat.find("**") == std::string::npos ? FNM_PATHNAME : 0) == 0;
+}
 
-    if (sqlite3_prepare_v2(conn, sql_classes, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, file_id);
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            ofs << "Name: " << reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)) << "\n";
-            ofs << "Defined at: lines " << sqlite3_column_int(stmt, 1) << "-" << sqlite3_column_int(stmt, 2) << "\n\n";
+//шаблон с * ? [ - glob по пути от корня проекта, если ничего нет - по хвосту пути с любого каталога
+//без них - совпадение по окончанию пути (первый файл)
+static std::vector<std::pair<int, std::string>> match_files(sqlite3* conn, const std::vector<std::string>& patterns) {
+    std::vector<std::pair<int, std::string>> result;
+    std::set<int> seen;
+    sqlite3_stmt* stmt;
+    for (const auto& pat : patterns) {
+        bool glob = pat.find_first_of("*?[") != std::string::npos;
+        const char* sql = glob ? "SELECT id, path FROM files WHERE path GLOB ? ORDER BY path;"
+                               : "SELECT id, path FROM files WHERE path LIKE '%' || ? LIMIT 1;";
+        bool any = false;
+        //GLOB в sqlite пропускает / под *, он только сужает выборку, точная проверка - path_glob
+        for (int pass = 0; pass < 2 && !any; pass++) {
+            bool suffix = pass == 1;
+            if (suffix && (!glob || pat[0] == '/')) break;
+            if (sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+                sqlite3_finalize(stmt);
+                break;
+            }
+            std::string bound = suffix ? "*/" + pat : pat;
+            sqlite3_bind_text(stmt, 1, bound.c_str(), -1, SQLITE_TRANSIENT);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                const char* path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                if (!path) continue;
+                if (glob) {
+                    bool ok = false;
+                    if (!suffix) ok = path_glob(pat, path);
+                    for (const char* p = strchr(path, '/'); suffix && p && !ok; p = strchr(p + 1, '/')) ok = path_glob(pat, p + 1);
+                    if (!ok) continue;
+                }
+                any = true;
+                int id = sqlite3_column_int(stmt, 0);
+                if (seen.insert(id).second) result.push_back({id, path});
+            }
+            sqlite3_finalize(stmt);
         }
+        if (!any) fprintf(stderr, "File not found: %s\n", pat.c_str());
     }
-    sqlite3_finalize(stmt);
-    ofs << "[FUNCTIONS]\n";
-
-    const char* sql_funcs =
-        "SELECT f.id, f.name, c.name, f.start_line, f.end_line, f.args "
-        "FROM functions f "
-        "LEFT JOIN classes c ON f.class_id = c.id "
-        "WHERE f.file_id = ?;";
-
-    if (sqlite3_prepare_v2(conn, sql_funcs, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, file_id);
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char* fname = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-            const char* cname = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-            const char* args = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
+    std::sort(result.begin(), result.end());
+    return result;
+}
 
+void DB::ents(const std::string& filename, bool include_builtin) {
+    ents(std::vector<std::string>{filename}, include_builtin, filename + ".ents.txt");
+}
 
-            if (cname)
-                ofs << "Name: " << cname << "." << fname << "\n";
-            else
-                ofs << "Name: " << fname << "\n";
+bool DB::ents(const std::vector<std::string>& patterns, bool include_builtin, const std::string& output_file) {
+    if (!conn) return false;
+    auto files = match_files(conn, patterns);
+    if (files.empty()) return false;
 
-            ofs << "Type: function\n";
-            ofs << "Defined at: lines " << sqlite3_column_int(stmt, 3) << "-" << sqlite3_column_int(stmt, 4) << "\n";
-            ofs << "Args: " << (args ? args : "") << "\n\n";
-        }
+    std::string out_path = output_file.empty() ? (patterns.size() == 1 ? patterns[0] + ".ents.txt" : "ents.txt") : output_file;
+    FILE* fp = fopen(out_path.c_str(), "w");
+    if (!fp) {
+        fprintf(stderr, "cannot write %s\n", out_path.c_str());
+        return false;
     }
-    sqlite3_finalize(stmt);
 
-    ofs << "[CALLS]\n";
-
-    const char* sql_calls =
-        "SELECT r.from_id, r.to_id, r.kind, r.args "
+    //все файлы одним проходом: каждый запрос отсортирован по file_id и читается синхронно с циклом по файлам
+    std::string ids;
+    for (const auto& f : files) ids += (ids.empty() ? "" : ",") + std::to_string(f.first);
+
+    std::string sql_classes =
+        "SELECT file_id, name, start_line, end_line FROM classes "
+        "WHERE file_id IN (" + ids + ") ORDER BY file_id, id;";
+    std::string sql_funcs =
+        "SELECT f.file_id, f.name, c.name, f.start_line, f.end_line, f.args "
+        "FROM functions f LEFT JOIN classes c ON f.class_id = c.id "
+        "WHERE f.file_id IN (" + ids + ") ORDER BY f.file_id, f.id;";
+    //только функции, на которые ссылается файл; inherit ссылки идут между классами и сюда не относятся
+    std::string sql_calls =
+        "SELECT f.file_id, f.name, fc.name, r.kind, t.name, tc.name, ic.name, r.to_id, r.args "
         "FROM refs r "
         "JOIN functions f ON r.from_id = f.id "
-        "WHERE f.file_id = ?;";
+        "LEFT JOIN classes fc ON f.class_id = fc.id "
+        "LEFT JOIN functions t ON r.kind = 'call' AND t.id = r.to_id "
+        "LEFT JOIN classes tc ON t.class_id = tc.id "
+        "LEFT JOIN classes ic ON r.kind = 'instantiate' AND ic.id = r.to_id "
+        "WHERE f.file_id IN (" + ids + ") AND r.kind != 'inherit'" +
+        (include_builtin ? "" : " AND r.to_id != 0") +
+        " ORDER BY f.file_id, r.id;";
+
+    sqlite3_stmt *classes = nullptr, *funcs = nullptr, *calls = nullptr;
+    sqlite3_prepare_v2(conn, sql_classes.c_str(), -1, &classes, nullptr);
+    sqlite3_prepare_v2(conn, sql_funcs.c_str(), -1, &funcs, nullptr);
+    sqlite3_prepare_v2(conn, sql_calls.c_str(), -1, &calls, nullptr);
+    bool has_class = classes && sqlite3_step(classes) == SQLITE_ROW;
+    bool has_func = funcs && sqlite3_step(funcs) == SQLITE_ROW;
+    bool has_call = calls && sqlite3_step(calls) == SQLITE_ROW;
+
+    ReportWriter w(fp);
+    for (const auto& file : files) {
+        int file_id = file.first;
+        w << "FILE: " << file.second.c_str() << "\n";
+        w << "===\n\n";
+
+        w << "[CLASSES]\n";
+        for (; has_class && sqlite3_column_int(classes, 0) == file_id; has_class = sqlite3_step(classes) == SQLITE_ROW) {
+            w << "Name: ";
+            w.column(classes, 1) << "\n";
+            w << "Defined at: lines " << sqlite3_column_int(classes, 2) << "-" << sqlite3_column_int(classes, 3) << "\n\n";
+        }
 
-    if (sqlite3_prepare_v2(conn, sql_calls, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, file_id);
+        w << "[FUNCTIONS]\n";
+        for (; has_func && sqlite3_column_int(funcs, 0) == file_id; has_func = sqlite3_step(funcs) == SQLITE_ROW) {
+            w << "Name: ";
+            w.qualified(funcs, 2, 1) << "\n";
+            w << "Type: function\n";
+            w << "Defined at: lines " << sqlite3_column_int(funcs, 3) << "-" << sqlite3_column_int(funcs, 4) << "\n";
+            w << "Args: ";
+            w.column(funcs, 5) << "\n\n";
+        }
 
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            int from_id = sqlite3_column_int(stmt, 0);
-            int to_id = sqlite3_column_int(stmt, 1);
-
-            std::string kind = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-            std::string args = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-
-            //from
-            auto& from = all_funcs[from_id];
-            if (!from.class_name.empty())
-                ofs << "From: " << from.class_name << "." << from.name << "\n";
-            else
-                ofs << "From: " << from.name << "\n";
-
-            //to
-            if (to_id != 0) {
-                auto it = all_funcs.find(to_id);
-                if (it != all_funcs.end()) {
-                    if (!it->second.class_name.empty())
-                        ofs << "To: " << it->second.class_name << "." << it->second.name << "\n";
-                    else
-                        ofs << "To: " << it->second.name << "\n";
-                } else {
-                    ofs << "To: <function #" << to_id << ">\n";
-                }
-                ofs << "Type: call\n";
+        w << "[CALLS]\n";
+        for (; has_call && sqlite3_column_int(calls, 0) == file_id; has_call = sqlite3_step(calls) == SQLITE_ROW) {
+            const char* kind = reinterpret_cast<const char*>(sqlite3_column_text(calls, 3));
+            int to_id = sqlite3_column_int(calls, 7);
+
+            w << "From: ";
+            w.qualified(calls, 2, 1) << "\n";
+
+            if (to_id == 0) {
+                w << "To: " << (kind && strncmp(kind, "call_builtin:", 13) == 0 ? kind + 13 : kind) << "\n";
+                w << "Type: builtin\n";
+            } else if (sqlite3_column_type(calls, 6) != SQLITE_NULL) {
+                w << "To: ";
+                w.column(calls, 6) << "\n";
+                w << "Type: instantiate\n";
             } else {
-                if (!include_builtin)
-                    continue;
-
-                std::string target = kind;
-                if (kind.rfind("call_builtin:", 0) == 0)
-                    target = kind.substr(strlen("call_builtin:"));
-
-                ofs << "To: " << target << "\n";
-                ofs << "Type: builtin\n";
+                w << "To: ";
+                if (sqlite3_column_type(calls, 4) != SQLITE_NULL) w.qualified(calls, 5, 4);
+                else w << "<function #" << to_id << ">";
+                w << "\n";
+                w << "Type: call\n";
             }
 
-            ofs << "Args: " << args << "\n\n";
+            w << "Args: ";
+            w.column(calls, 8) << "\n\n";
         }
     }
-    sqlite3_finalize(stmt);
+    w.flush();
 
-    ofs.close();
+    sqlite3_finalize(classes);
+    sqlite3_finalize(funcs);
+    sqlite3_finalize(calls);
+    return fclose(fp) == 0;
 }
 
-void DB::add_import(int file_id, const std::string& module, const std::string& name) {
-    const char* sql = "INSERT INTO imports(file_id, module, name) VALUES(?, ?, ?);";
+bool DB::add_import(int file_id, const std::string& module, const std::string& name, int target_file_id) {
+    if (!conn) return false;
+    const char* sql = "INSERT INTO imports(file_id, module, name, target_file_id) VALUES(?, ?, ?, ?);";
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr) == SQLITE_OK) {
         sqlite3_bind_int(stmt, 1, file_id);
         sqlite3_bind_text(stmt, 2, module.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_text(stmt, 3, name.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_step(stmt);
+        sqlite3_bind_int(stmt, 4, target_file_id);
     }
-    sqlite3_finalize(stmt);
+    if (!insert_done(conn, stmt)) return false;
+    touch();
+    return true;
 }
 
-bool DB::is_project_module(const std::string& module) const {
-    //модуль считается проектным если есть файл с таким именем в БД
+bool DB::add_export(int file_id, const std::string& name) {
+    if (!conn) return false;
+    const char* sql = "INSERT INTO exports(file_id, name) VALUES(?, ?);";
     sqlite3_stmt* stmt;
-    const char* sql = "SELECT 1 FROM files WHERE path LIKE ? LIMIT 1;";
-    bool result = false;
     if (sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        std::string pattern = "%" + module + ".py";
-        sqlite3_bind_text(stmt, 1, pattern.c_str(), -1, SQLITE_STATIC);
-        if (sqlite3_step(stmt) == SQLITE_ROW) result = true;
+        sqlite3_bind_int(stmt, 1, file_id);
+        sqlite3_bind_text(stmt, 2, name.c_str(), -1, SQLITE_TRANSIENT);
     }
-    sqlite3_finalize(stmt);
+    if (!insert_done(conn, stmt)) return false;
+    touch();
+    return true;
+}
+
+bool DB::is_project_module(const std::string& module) const {
+    //модуль считается проектным если есть файл с таким именем в БД
+    return resolve_module(module) != 0;
+}
+
+//верхние модули импортов по одному на строку
+static bool write_top_modules(const std::string& save_file, const std::vector<Import>& imports) {
+    std::set<std::string> top_modules;
+    for (const auto& imp : imports) {
+        // топ-модуль
+        if (imp.module.empty()) continue;
+        size_t pos = imp.module.find('.');
+        top_modules.insert(pos != std::string::npos ? imp.module.substr(0, pos) : imp.module);
+    }
+    std::ofstream out(save_file);
+    if (!out.is_open()) {
+        std::cerr << "fail to open file: " << save_file << "\n";
+        return false;
+    }
+    for (const auto& m : top_modules) out << m << "\n";
+    out.close();
+    return (bool)out;
+}
+
+std::vector<Import> DB::get_all_imports(const std::string& save_file, const QueryFilter& filter) {
+    //кэшируется только выборка, файл пишется всегда - он дешевый и мог измениться
+    std::string cache_key = "get_all_imports|" + filter_key(filter);
+    std::vector<Import> result;
+    if (auto hit = cache_get<std::vector<Import>>(cache_key)) {
+        result = *hit;
+    } else {
+        result = query_imports(filter);
+        cache_put(cache_key, result);
+    }
+
+    if (!save_file.empty()) write_top_modules(save_file, result);
     return result;
 }
 
-std::vector<Import> DB::get_all_imports(const std::string& save_file = "") {
+bool DB::save_imports(const std::string& save_file, const QueryFilter& filter) {
+    return write_top_modules(save_file, get_all_imports("", filter));
+}
+
+std::vector<Import> DB::query_imports(const QueryFilter& filter) {
     std::vector<Import> result;
-    std::set<std::string> top_modules;
 
-    const char* sql = "SELECT file_id, module, name FROM imports;";
+    SqlWhere where;
+    bool by_path = !filter.path_prefix.empty() || !filter.path_glob.empty();
+    add_path_filter(where, filter, "fl.path", "i.file_id");
+    if (!filter.module_prefix.empty()) where.text("i.module GLOB ?", glob_prefix(filter.module_prefix));
+
+    std::string sql =
+        "SELECT i.file_id, i.module, i.name, i.target_file_id FROM imports i" +
+        std::string(by_path ? " JOIN files fl ON i.file_id = fl.id" : "") +
+        where.sql() + " ORDER BY i.id" + limit_sql(filter) + ";";
     sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        where.bind(stmt);
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             Import imp;
             imp.file_id = sqlite3_column_int(stmt, 0);
+            imp.target_file_id = sqlite3_column_int(stmt, 3);
             const unsigned char* module_text = sqlite3_column_text(stmt, 1);
             const unsigned char* name_text = sqlite3_column_text(stmt, 2);
             imp.module = module_text ? reinterpret_cast<const char*>(module_text) : "";
             imp.name = name_text   ? reinterpret_cast<const char*>(name_text)   : "";
             result.push_back(imp);
-
-            // топ-модуль
-            if (!imp.module.empty()) {
-                size_t pos = imp.module.find('.');
-                std::string top = (pos != std::string::npos) ? imp.module.substr(0, pos) : imp.module;
-                top_modules.insert(top);
-            }
         }
     }
     sqlite3_finalize(stmt);
-
-    if (!save_file.empty()) {
-        std::ofstream out(save_file);
-        for (const auto& m : top_modules) out << m << "\n";
-        out.close();
-    }
-
     return result;
 }
 
-std::vector<DangerousCall> DB::get_dangerous() {
-    std::vector<DangerousCall> result;
-    if (!conn) return result;
-
-    std::unordered_set<std::string> dangerous = {
+static const std::unordered_set<std::string>& dangerous_names() {
+    static const std::unordered_set<std::string> dangerous = {
         "eval", "exec", "execfile", "compile",
         "os.system", "os.popen", "os.popen2", "os.popen3", "os.popen4",
         "os.execv", "os.execve", "os.execvp", "os.execl", "os.execle",
@@ -569,148 +954,1945 @@ std::vector<DangerousCall> DB::get_dangerous() {
         "sqlite3.connect.execute", "sqlite3.connect.executemany",
         "sqlite3.Cursor.execute", "sqlite3.Cursor.executemany"
     };
+    return dangerous;
+}
 
-    sqlite3_stmt* stmt;
-    //возвращает все вызовы функций с информацией о функции источнике и файле
-    const char* sql = 
-        "SELECT r.id, r.from_id, r.to_id, r.kind, r.args, "
-        "f.name as from_name, c.name as from_class, "
-        "f.file_id, f.start_line, fl.path as file_path "
-        "FROM refs r "
-        "JOIN functions f ON r.from_id = f.id "
-        "LEFT JOIN classes c ON f.class_id = c.id "
-        "JOIN files fl ON f.file_id = fl.id "
-        "WHERE r.kind LIKE 'call_%' "
-        "ORDER BY fl.path, f.start_line;";
+//имя вызываемой функции из kind вида call_builtin:name
+static std::string builtin_target(const std::string& kind) {
+    std::string target_func = kind.substr(13);
+    size_t pipe_pos = target_func.find('|');
+    if (pipe_pos != std::string::npos) {
+        target_func = target_func.substr(0, pipe_pos);
+    }
+    if (!target_func.empty()) {
+        if (target_func.front() == '"' || target_func.front() == '\'') {
+            target_func = target_func.substr(1);
+        }
+        if (!target_func.empty() && (target_func.back() == '"' || target_func.back() == '\'')) {
+            target_func.pop_back();
+        }
+        size_t paren_pos = target_func.find('(');
+        if (paren_pos != std::string::npos) {
+            target_func = target_func.substr(0, paren_pos);
+        }
+    }
+    return target_func;
+}
 
-    if (sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            int ref_id = sqlite3_column_int(stmt, 0);
-            int from_id = sqlite3_column_int(stmt, 1);
-
-            int to_id = sqlite3_column_int(stmt, 2);
-
-
-            const char* kind_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-            const char* args_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-            const char* from_name_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
-            const char* from_class_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6));
-
-
-            int file_id = sqlite3_column_int(stmt, 7);
-            int line = sqlite3_column_int(stmt, 8);
-            const char* file_path_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 9));
-
-            std::string kind = kind_c ? kind_c : "";
-            std::string args = args_c ? args_c : "";
-            std::string from_name = from_name_c ? from_name_c : "";
-            std::string from_class = from_class_c ? from_class_c : "";
-            std::string file_path = file_path_c ? file_path_c : "";
-            
-            std::string from_func;
-            if (!from_name.empty()) {
-                if (!from_class.empty()) {
-                    from_func = from_class + "." + from_name;
-                } else {
-                    from_func = from_name;
-                }
-            } else {
-                from_func = "<anonymous>";
-            }
+static bool is_dangerous_target(const std::string& target_func) {
+    const auto& dangerous = dangerous_names();
+    if (dangerous.count(target_func)) return true;
 
-            //определение вызываемой функции
-            std::string target_func;
-            bool is_external_call = false;
-            
-            if (kind.rfind("call_builtin:", 0) == 0) {
-                target_func = kind.substr(13);
-                is_external_call = true;
-            } 
-            if (is_external_call) {
-                size_t pipe_pos = target_func.find('|');
-                if (pipe_pos != std::string::npos) {
-                    target_func = target_func.substr(0, pipe_pos);
-                }
-                if (!target_func.empty()) {
-                    if (target_func.front() == '"' || target_func.front() == '\'') {
-                        target_func = target_func.substr(1);
-                    }
-                    if (target_func.back() == '"' || target_func.back() == '\'') {
-                        target_func.pop_back();
-                    }
-                    size_t paren_pos = target_func.find('(');
-                    if (paren_pos != std::string::npos) {
-                        target_func = target_func.substr(0, paren_pos);
-                    }
-                }
-            }
-            else if (to_id != 0) {
-                sqlite3_stmt* func_stmt;
-                const char* func_sql = "SELECT name, class_id FROM functions WHERE id = ?;";
-                if (sqlite3_prepare_v2(conn, func_sql, -1, &func_stmt, nullptr) == SQLITE_OK) {
-                    sqlite3_bind_int(func_stmt, 1, to_id);
-                    if (sqlite3_step(func_stmt) == SQLITE_ROW) {
-                        const char* target_name_c = reinterpret_cast<const char*>(sqlite3_column_text(func_stmt, 0));
-                        int target_class_id = sqlite3_column_int(func_stmt, 1);
-                        
-                        std::string target_name = target_name_c ? target_name_c : "";
-                        if (target_class_id != 0) {
-                            sqlite3_stmt* class_stmt;
-                            const char* class_sql = "SELECT name FROM classes WHERE id = ?;";
-                            if (sqlite3_prepare_v2(conn, class_sql, -1, &class_stmt, nullptr) == SQLITE_OK) {
-                                sqlite3_bind_int(class_stmt, 1, target_class_id);
-                                if (sqlite3_step(class_stmt) == SQLITE_ROW) {
-                                    const char* class_name_c = reinterpret_cast<const char*>(sqlite3_column_text(class_stmt, 0));
-                                    std::string class_name = class_name_c ? class_name_c : "";
-                                    target_func = class_name + "." + target_name;
-                                }
-                                sqlite3_finalize(class_stmt);
-                            }
-                        } else {
-                            target_func = target_name;
-                        }
-                    }
-                    sqlite3_finalize(func_stmt);
-                }
-            }
+    //проверка модуля (например os.*)
+    size_t dot_pos = target_func.find('.');
+    if (dot_pos != std::string::npos) {
+        std::string module = target_func.substr(0, dot_pos);
+        for (const auto& danger_func : dangerous) {
+            if (danger_func.find(module + ".") == 0) return true;
+        }
+    }
+    return false;
+}
 
-            if (!target_func.empty()) {
-                bool is_dangerous = false;
-                
-                if (dangerous.count(target_func)) {
-                    is_dangerous = true;
-                }
-                //проверка модуля (например os.*)
-                else {
-                    size_t dot_pos = target_func.find('.');
-                    if (dot_pos != std::string::npos) {
-                        std::string module = target_func.substr(0, dot_pos);
-                        std::string func_name = target_func.substr(dot_pos + 1);
-                        
-                        for (const auto& danger_func : dangerous) {
-                            if (danger_func.find(module + ".") == 0) {
-                                is_dangerous = true;
-                                break;
-                            }
-                        }
-                    }
-                    else if (dangerous.count(target_func)) {
-                        is_dangerous = true;
-                    }
-                }
+//все вызовы функций с информацией о функции источнике, файле и цели
+static const char* DANGEROUS_SQL =
+    "SELECT r.kind, f.name, c.name, f.start_line, fl.path, tf.name, tc.name, tf.class_id "
+    "FROM refs r "
+    "JOIN functions f ON r.from_id = f.id "
+    "LEFT JOIN classes c ON f.class_id = c.id "
+    "JOIN files fl ON f.file_id = fl.id "
+    "LEFT JOIN functions tf ON r.to_id != 0 AND r.to_id = tf.id "
+    "LEFT JOIN classes tc ON tf.class_id = tc.id";
+
+//текущая строка DANGEROUS_SQL -> DangerousCall, false если вызов не опасный
+static bool dangerous_from_row(sqlite3_stmt* stmt, DangerousCall& dc) {
+    const char* kind_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    const char* from_name_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    const char* from_class_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+    const char* target_name_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 5));
+    const char* target_class_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6));
+
+    //определение вызываемой функции
+    std::string target_func;
+    if (kind_c && strncmp(kind_c, "call_builtin:", 13) == 0) {
+        target_func = builtin_target(kind_c);
+    } else if (target_name_c) {
+        if (sqlite3_column_int(stmt, 7) != 0) {
+            if (target_class_c) target_func = std::string(target_class_c) + "." + target_name_c;
+        } else {
+            target_func = target_name_c;
+        }
+    }
+    if (target_func.empty() || !is_dangerous_target(target_func)) return false;
 
-                if (is_dangerous) {
-                    DangerousCall dc;
-                    dc.function = target_func;
-                    dc.from = from_func;
-                    dc.line = line;
-                    dc.file = file_path;
-                    result.push_back(dc);
-                }
-            }
+    const char* file_path_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+
+    dc.function = target_func;
+    if (from_name_c && from_name_c[0]) {
+        dc.from = (from_class_c && from_class_c[0]) ? std::string(from_class_c) + "." + from_name_c : from_name_c;
+    } else {
+        dc.from = "<anonymous>";
+    }
+    dc.line = sqlite3_column_int(stmt, 3);
+    dc.file = file_path_c ? file_path_c : "";
+    return true;
+}
+
+sqlite3_stmt* DB::prepare_dangerous(const QueryFilter& filter) {
+    if (!conn) return nullptr;
+
+    SqlWhere where;
+    add_path_filter(where, filter, "fl.path", "f.file_id");
+    if (!filter.sinks.empty()) {
+        //builtin цели хранятся как call_builtin:name
+        std::string in = "r.kind IN (";
+        for (size_t i = 0; i < filter.sinks.size(); i++) {
+            in += i ? ",?" : "?";
+            where.params.push_back({false, 0, "call_builtin:" + filter.sinks[i]});
         }
+        where.clauses.push_back(in + ")");
+    }
+    if (filter.line_min > 0) where.integer("f.start_line >= ?", filter.line_min);
+    if (filter.line_max > 0) where.integer("f.start_line <= ?", filter.line_max);
+
+    std::string sql = std::string(DANGEROUS_SQL) + where.sql("r.kind LIKE 'call_%'") + " ORDER BY fl.path, f.start_line;";
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "fail to prepare statement: " << sqlite3_errmsg(conn) << "\n";
         sqlite3_finalize(stmt);
+        return nullptr;
     }
+    where.bind(stmt);
+    return stmt;
+}
 
-    return result;
+//опасность определяется после sql, поэтому limit/offset считаются здесь
+template <typename Emit>
+static void scan_dangerous(sqlite3_stmt* stmt, const QueryFilter& filter, Emit emit) {
+    if (!stmt) return;
+    DangerousCall dc;
+    int skipped = 0, taken = 0;
+    while ((filter.limit < 0 || taken < filter.limit) && sqlite3_step(stmt) == SQLITE_ROW) {
+        if (!dangerous_from_row(stmt, dc)) continue;
+        if (skipped < filter.offset) { skipped++; continue; }
+        emit(dc);
+        taken++;
+    }
+    sqlite3_finalize(stmt);
+}
+
+std::vector<DangerousCall> DB::get_dangerous(const QueryFilter& filter) {
+    std::string cache_key = "get_dangerous" + filter_key(filter);
+    if (auto hit = cache_get<std::vector<DangerousCall>>(cache_key)) return *hit;
+
+    std::vector<DangerousCall> result;
+    scan_dangerous(prepare_dangerous(filter), filter, [&](const DangerousCall& dc) { result.push_back(dc); });
+    return cache_put(cache_key, result);
+}
+
+static bool match_entry(const std::vector<std::string>& patterns, const std::string& qualified) {
+    size_t dot = qualified.rfind('.');
+    std::string bare = (dot != std::string::npos) ? qualified.substr(dot + 1) : qualified;
+    for (const auto& p : patterns) {
+        if (fnmatch(p.c_str(), qualified.c_str(), 0) == 0) return true;
+        if (fnmatch(p.c_str(), bare.c_str(), 0) == 0) return true;
+    }
+    return false;
+}
+
+//граф для get_dangerous_paths, строится один раз на write_version и живет в кэше результатов
+//оставлены только узлы, из которых достижим sink (у остальных пустое имя), и ребра между ними
+struct DangerousGraph {
+    struct Sink { int from; std::string name; int line; };
+    std::vector<PathHop> nodes;     //имя, файл, строка определения
+    std::vector<int> edge_start;    //ребра узла v: [edge_start[v], edge_start[v + 1])
+    std::vector<int> edge_to;
+    std::vector<int> edge_line;
+    std::vector<Sink> sinks;
+};
+
+std::shared_ptr<const DangerousGraph> DB::dangerous_graph() {
+    const std::string cache_key = "dangerous_graph";
+    if (auto hit = cache_get<std::shared_ptr<const DangerousGraph>>(cache_key)) return *hit;
+
+    auto graph = std::make_shared<DangerousGraph>();
+    if (!conn) return graph;
+    auto& fns = graph->nodes;
+    struct Edge { int to; int line; };
+
+    //узел 0 - код уровня модуля без файла (старые БД), узлы после функций - модули файлов
+    fns.assign(1, {"<module>", "", 0});
+    sqlite3_stmt* stmt = nullptr;
+
+    const char* sql_funcs =
+        "SELECT f.id, f.name, c.name, fl.path, f.start_line "
+        "FROM functions f "
+        "LEFT JOIN classes c ON f.class_id = c.id "
+        "LEFT JOIN files fl ON f.file_id = fl.id;";
+    if (sqlite3_prepare_v2(conn, sql_funcs, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int id = sqlite3_column_int(stmt, 0);
+            const char* fname = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            const char* cname = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            const char* path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            if (id <= 0) continue;
+            if ((size_t)id >= fns.size()) fns.resize(id + 1);
+            std::string name = fname ? fname : "<unnamed>";
+            fns[id] = {cname ? std::string(cname) + "." + name : name, path ? path : "", sqlite3_column_int(stmt, 4)};
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    std::unordered_map<int, int> module_node;
+    if (sqlite3_prepare_v2(conn, "SELECT id, path FROM files;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            module_node.emplace(sqlite3_column_int(stmt, 0), (int)fns.size());
+            fns.push_back({"<module>", path ? path : "", 0});
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    //instantiate ссылается на класс, вызов идет в его __init__
+    std::unordered_map<int, int> class_init;
+    const char* sql_init = "SELECT class_id, id FROM functions WHERE name = '__init__' AND class_id != 0;";
+    if (sqlite3_prepare_v2(conn, sql_init, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            class_init.emplace(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    size_t n = fns.size();
+    std::vector<std::vector<Edge>> out(n);
+    std::vector<std::vector<int>> in(n);
+
+    std::string sql_refs = std::string("SELECT from_id, to_id, kind, line, ") +
+        (has_column(conn, "refs", "file_id") ? "file_id" : "0") + " FROM refs "
+        "WHERE kind IN ('call', 'instantiate') OR kind LIKE 'call_builtin:%';";
+    if (sqlite3_prepare_v2(conn, sql_refs.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "fail to prepare statement: " << sqlite3_errmsg(conn) << "\n";
+        sqlite3_finalize(stmt);
+        return graph;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int from = sqlite3_column_int(stmt, 0);
+        int to = sqlite3_column_int(stmt, 1);
+        const char* kind_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        int line = sqlite3_column_int(stmt, 3);
+        if (from == 0) {
+            auto it = module_node.find(sqlite3_column_int(stmt, 4));
+            if (it != module_node.end()) from = it->second;
+        }
+        if (from < 0 || (size_t)from >= n || !kind_c) continue;
+
+        if (strcmp(kind_c, "call") == 0) {
+            if (to <= 0 || (size_t)to >= n) continue;
+        } else if (strcmp(kind_c, "instantiate") == 0) {
+            auto it = class_init.find(to);
+            if (it == class_init.end() || (size_t)it->second >= n) continue;
+            to = it->second;
+        } else {
+            std::string target = builtin_target(kind_c);
+            if (is_dangerous_target(target)) graph->sinks.push_back({from, target, line});
+            continue;
+        }
+        out[from].push_back({to, line});
+        in[to].push_back(from);
+    }
+    sqlite3_finalize(stmt);
+
+    //обратная достижимость: из каких функций достижим хотя бы один sink
+    std::vector<char> reaches(n, 0);
+    std::deque<int> queue;
+    for (const auto& s : graph->sinks) {
+        if (!reaches[s.from]) { reaches[s.from] = 1; queue.push_back(s.from); }
+    }
+    while (!queue.empty()) {
+        int v = queue.front(); queue.pop_front();
+        for (int u : in[v]) {
+            if (!reaches[u]) { reaches[u] = 1; queue.push_back(u); }
+        }
+    }
+
+    graph->edge_start.assign(n + 1, 0);
+    for (size_t v = 0; v < n; v++) {
+        graph->edge_start[v] = (int)graph->edge_to.size();
+        if (!reaches[v]) {
+            fns[v] = PathHop{};
+            continue;
+        }
+        for (const auto& e : out[v]) {
+            if (!reaches[e.to]) continue;
+            graph->edge_to.push_back(e.to);
+            graph->edge_line.push_back(e.line);
+        }
+    }
+    graph->edge_start[n] = (int)graph->edge_to.size();
+
+    std::shared_ptr<const DangerousGraph> result = graph;
+    return cache_put(cache_key, result);
+}
+
+std::vector<DangerousPath> DB::get_dangerous_paths(const std::vector<std::string>& entry_patterns) {
+    std::string cache_key = "get_dangerous_paths" + list_key(entry_patterns);
+    if (auto hit = cache_get<std::vector<DangerousPath>>(cache_key)) return *hit;
+
+    std::vector<DangerousPath> result;
+    if (!conn) return result;
+
+    auto graph = dangerous_graph();
+    const auto& fns = graph->nodes;
+    size_t n = fns.size();
+    if (n == 0) return result;
+
+    //bfs от точек входа только по функциям, из которых достижим sink
+    std::vector<int> parent(n, -1);
+    std::vector<int> parent_line(n, 0);
+    std::deque<int> queue;
+    for (size_t id = 0; id < n; id++) {
+        if (fns[id].function.empty()) continue;
+        if (match_entry(entry_patterns, fns[id].function)) {
+            parent[id] = (int)id;
+            queue.push_back((int)id);
+        }
+    }
+    while (!queue.empty()) {
+        int v = queue.front(); queue.pop_front();
+        for (int e = graph->edge_start[v]; e < graph->edge_start[v + 1]; e++) {
+            int to = graph->edge_to[e];
+            if (parent[to] != -1) continue;
+            parent[to] = v;
+            parent_line[to] = graph->edge_line[e];
+            queue.push_back(to);
+        }
+    }
+
+    for (const auto& s : graph->sinks) {
+        if (parent[s.from] == -1) continue;
+
+        std::vector<int> chain;
+        for (int v = s.from; ; v = parent[v]) {
+            chain.push_back(v);
+            if (parent[v] == v) break;
+        }
+        std::reverse(chain.begin(), chain.end());
+
+        DangerousPath dp;
+        dp.sink = s.name;
+        dp.entry = fns[chain.front()].function;
+        //hop - место вызова внутри функции цепочки
+        for (size_t i = 0; i < chain.size(); i++) {
+            const auto& fn = fns[chain[i]];
+            int line = (i + 1 < chain.size()) ? parent_line[chain[i + 1]] : s.line;
+            dp.hops.push_back({fn.function, fn.file, line});
+        }
+        result.push_back(dp);
+    }
+
+    return cache_put(cache_key, result);
+}
+
+std::vector<DeadSymbol> DB::dead_code(const std::vector<std::string>& roots) {
+    std::string cache_key = "dead_code" + list_key(roots);
+    if (auto hit = cache_get<std::vector<DeadSymbol>>(cache_key)) return *hit;
+
+    std::vector<DeadSymbol> result;
+    if (!conn) return result;
+
+    struct Sym { std::string name; int class_id; int file_id; int start_line; int end_line; std::string decorators; };
+
+    std::map<int, std::string> paths;
+    for (const auto& f : files()) paths[f.id] = f.path;
+
+    sqlite3_stmt* stmt = nullptr;
+    std::map<int, Sym> funcs;
+    std::map<int, Sym> classes;
+
+    const char* sql_funcs = "SELECT id, name, class_id, file_id, start_line, end_line, decorators FROM functions;";
+    if (sqlite3_prepare_v2(conn, sql_funcs, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            const char* decs = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6));
+            funcs[sqlite3_column_int(stmt, 0)] = {
+                name ? name : "", sqlite3_column_int(stmt, 2), sqlite3_column_int(stmt, 3),
+                sqlite3_column_int(stmt, 4), sqlite3_column_int(stmt, 5), decs ? decs : ""
+            };
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    const char* sql_classes = "SELECT id, name, file_id, start_line, end_line FROM classes;";
+    if (sqlite3_prepare_v2(conn, sql_classes, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            classes[sqlite3_column_int(stmt, 0)] = {
+                name ? name : "", 0, sqlite3_column_int(stmt, 2),
+                sqlite3_column_int(stmt, 3), sqlite3_column_int(stmt, 4), ""
+            };
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    //функции и классы в одном пространстве узлов: [0..fn_base) функции, 0 - код модуля, затем классы
+    int fn_base = funcs.empty() ? 1 : funcs.rbegin()->first + 1;
+    int class_max = classes.empty() ? 0 : classes.rbegin()->first;
+    int n = fn_base + class_max + 1;
+    auto class_node = [&](int cid) { return fn_base + cid; };
+
+    std::vector<std::pair<int, int>> edges;
+
+    const char* sql_refs = "SELECT from_id, to_id, kind FROM refs WHERE kind IN ('call', 'instantiate', 'inherit');";
+    if (sqlite3_prepare_v2(conn, sql_refs, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int from = sqlite3_column_int(stmt, 0);
+            int to = sqlite3_column_int(stmt, 1);
+            const char* kind = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            if (!kind || from < 0 || to <= 0) continue;
+            if (strcmp(kind, "call") == 0) {
+                if (from < fn_base && to < fn_base) edges.push_back({from, to});
+            } else if (strcmp(kind, "instantiate") == 0) {
+                if (from < fn_base && to <= class_max) edges.push_back({from, class_node(to)});
+            } else if (from <= class_max && to <= class_max) { //inherit: потомок использует предка
+                edges.push_back({class_node(from), class_node(to)});
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    auto is_dunder = [](const std::string& name) {
+        return name.size() > 4 && name.compare(0, 2, "__") == 0 && name.compare(name.size() - 2, 2, "__") == 0;
+    };
+
+    //метод использует свой класс, экземпляр класса - свои dunder методы
+    std::map<int, std::vector<const std::pair<const int, Sym>*>> by_file;
+    for (const auto& kv : funcs) {
+        const Sym& fn = kv.second;
+        if (fn.class_id && fn.class_id <= class_max) {
+            edges.push_back({kv.first, class_node(fn.class_id)});
+            if (is_dunder(fn.name)) edges.push_back({class_node(fn.class_id), kv.first});
+        } else {
+            by_file[fn.file_id].push_back(&kv);
+        }
+    }
+
+    //декорированная функция использует декоратор
+    std::unordered_map<std::string, std::vector<int>> globals_by_name;
+    for (const auto& kv : funcs) {
+        if (!kv.second.class_id) globals_by_name[kv.second.name].push_back(kv.first);
+    }
+    for (const auto& kv : funcs) {
+        std::stringstream ss(kv.second.decorators);
+        std::string dec;
+        while (std::getline(ss, dec, ',')) {
+            size_t dot = dec.rfind('.');
+            auto it = globals_by_name.find(dot != std::string::npos ? dec.substr(dot + 1) : dec);
+            if (it == globals_by_name.end()) continue;
+            for (int target : it->second) edges.push_back({kv.first, target});
+        }
+    }
+
+    //вложенные функции достижимы из внешней
+    for (auto& kv : by_file) {
+        auto& list = kv.second;
+        std::sort(list.begin(), list.end(), [](auto* a, auto* b) { return a->second.start_line < b->second.start_line; });
+        std::vector<const std::pair<const int, Sym>*> open;
+        for (auto* fn : list) {
+            while (!open.empty() && open.back()->second.end_line < fn->second.start_line) open.pop_back();
+            if (!open.empty()) edges.push_back({open.back()->first, fn->first});
+            open.push_back(fn);
+        }
+    }
+
+    //csr
+    std::vector<int> offsets(n + 1, 0);
+    for (const auto& e : edges) offsets[e.first + 1]++;
+    for (int i = 0; i < n; i++) offsets[i + 1] += offsets[i];
+    std::vector<int> targets(edges.size());
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for (const auto& e : edges) targets[fill[e.first]++] = e.second;
+
+    std::vector<uint64_t> seen((n + 63) / 64, 0);
+    std::vector<int> stack;
+    auto mark = [&](int v) {
+        uint64_t bit = uint64_t(1) << (v & 63);
+        if (seen[v >> 6] & bit) return;
+        seen[v >> 6] |= bit;
+        stack.push_back(v);
+    };
+
+    std::vector<std::string> patterns;
+    bool root_module = roots.empty(), root_dunder = roots.empty();
+    bool root_decorated = roots.empty(), root_exported = roots.empty();
+    for (const auto& r : roots) {
+        if (r == "<module>") root_module = true;
+        else if (r == "<dunder>") root_dunder = true;
+        else if (r == "<decorated>") root_decorated = true;
+        else if (r == "<exported>") root_exported = true;
+        else patterns.push_back(r);
+    }
+
+    std::set<std::pair<int, std::string>> exported;
+    if (root_exported && sqlite3_prepare_v2(conn, "SELECT file_id, name FROM exports;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            if (name) exported.insert({sqlite3_column_int(stmt, 0), name});
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    auto qualified = [&](const Sym& fn) {
+        auto it = fn.class_id ? classes.find(fn.class_id) : classes.end();
+        return it != classes.end() ? it->second.name + "." + fn.name : fn.name;
+    };
+
+    if (root_module) mark(0);
+    for (const auto& kv : funcs) {
+        const Sym& fn = kv.second;
+        if ((root_dunder && is_dunder(fn.name))
+            || (root_decorated && !fn.decorators.empty())
+            || (root_exported && fn.class_id == 0 && exported.count({fn.file_id, fn.name}))
+            || (!patterns.empty() && match_entry(patterns, qualified(fn)))) {
+            mark(kv.first);
+        }
+    }
+    for (const auto& kv : classes) {
+        if ((root_exported && exported.count({kv.second.file_id, kv.second.name}))
+            || (!patterns.empty() && match_entry(patterns, kv.second.name))) {
+            mark(class_node(kv.first));
+        }
+    }
+
+    while (!stack.empty()) {
+        int v = stack.back(); stack.pop_back();
+        for (int i = offsets[v]; i < offsets[v + 1]; i++) mark(targets[i]);
+    }
+
+    auto is_seen = [&](int v) { return (seen[v >> 6] >> (v & 63)) & 1; };
+    for (const auto& kv : classes) {
+        if (is_seen(class_node(kv.first))) continue;
+        const Sym& c = kv.second;
+        result.push_back({"class", c.name, paths[c.file_id], c.start_line, c.end_line});
+    }
+    for (const auto& kv : funcs) {
+        if (is_seen(kv.first)) continue;
+        const Sym& fn = kv.second;
+        result.push_back({fn.class_id ? "method" : "function", qualified(fn), paths[fn.file_id], fn.start_line, fn.end_line});
+    }
+    std::sort(result.begin(), result.end(), [](const DeadSymbol& a, const DeadSymbol& b) {
+        return a.file != b.file ? a.file < b.file : a.start_line < b.start_line;
+    });
+
+    return cache_put(cache_key, result);
+}
+
+//c3-линеаризация, при конфликте - обход в глубину слева направо без повторов
+static std::vector<int> c3_mro(int cls, const std::map<int, std::vector<int>>& bases,
+                               std::map<int, std::vector<int>>& memo, std::set<int>& in_progress) {
+    auto it = memo.find(cls);
+    if (it != memo.end()) return it->second;
+    if (in_progress.count(cls)) return {cls}; //цикл в наследовании
+    in_progress.insert(cls);
+
+    std::vector<std::vector<int>> seqs;
+    auto bit = bases.find(cls);
+    std::vector<int> direct = bit != bases.end() ? bit->second : std::vector<int>{};
+    for (int b : direct) seqs.push_back(c3_mro(b, bases, memo, in_progress));
+    seqs.push_back(direct);
+
+    std::vector<int> result{cls};
+    bool ok = true;
+    while (true) {
+        seqs.erase(std::remove_if(seqs.begin(), seqs.end(), [](const std::vector<int>& q) { return q.empty(); }), seqs.end());
+        if (seqs.empty()) break;
+        int head = 0;
+        bool found = false;
+        for (const auto& q : seqs) {
+            head = q.front();
+            bool in_tail = false;
+            for (const auto& other : seqs) {
+                if (std::find(other.begin() + 1, other.end(), head) != other.end()) { in_tail = true; break; }
+            }
+            if (!in_tail) { found = true; break; }
+        }
+        if (!found) { ok = false; break; }
+        result.push_back(head);
+        for (auto& q : seqs) {
+            if (!q.empty() && q.front() == head) q.erase(q.begin());
+        }
+    }
+
+    if (!ok) {
+        result = {cls};
+        std::set<int> seen{cls};
+        for (int b : direct) {
+            for (int a : c3_mro(b, bases, memo, in_progress)) {
+                if (seen.insert(a).second) result.push_back(a);
+            }
+        }
+    }
+
+    in_progress.erase(cls);
+    memo[cls] = result;
+    return result;
+}
+
+bool DB::build_class_hierarchy() {
+    if (!conn) return false;
+
+    std::map<int, std::string> raw_bases;
+    std::unordered_map<std::string, int> id_by_name;
+    sqlite3_stmt* stmt = nullptr;
+
+    if (sqlite3_prepare_v2(conn, "SELECT id, name, bases FROM classes ORDER BY id;", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "fail to prepare statement: " << sqlite3_errmsg(conn) << "\n";
+        return false;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int id = sqlite3_column_int(stmt, 0);
+        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const char* bases = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        if (name) id_by_name.emplace(name, id);
+        raw_bases[id] = bases ? bases : "";
+    }
+    sqlite3_finalize(stmt);
+
+    //разрешение баз по имени (abc.ABC -> ABC)
+    std::map<int, std::vector<int>> bases;
+    for (const auto& kv : raw_bases) {
+        auto& list = bases[kv.first];
+        std::stringstream ss(kv.second);
+        std::string base;
+        while (std::getline(ss, base, ',')) {
+            size_t dot = base.rfind('.');
+            auto it = id_by_name.find(dot != std::string::npos ? base.substr(dot + 1) : base);
+            if (it != id_by_name.end() && it->second != kv.first) list.push_back(it->second);
+        }
+    }
+
+    std::map<int, std::vector<int>> memo;
+    std::set<int> in_progress;
+    for (const auto& kv : bases) c3_mro(kv.first, bases, memo, in_progress);
+
+    //эйлеров обход леса по первым базам
+    std::map<int, std::vector<int>> children;
+    std::vector<int> roots;
+    for (const auto& kv : bases) {
+        if (kv.second.empty()) roots.push_back(kv.first);
+        else children[kv.second.front()].push_back(kv.first);
+    }
+    std::map<int, std::pair<int, int>> labels;
+    int counter = 0;
+    std::function<void(int)> tour = [&](int cls) {
+        if (labels.count(cls)) return;
+        labels[cls].first = counter++;
+        for (int ch : children[cls]) tour(ch);
+        labels[cls].second = counter++;
+    };
+    for (int r : roots) tour(r);
+    for (const auto& kv : bases) tour(kv.first); //классы в циклах
+
+    //при ошибке старые class_mro/class_tree остаются целыми, транзакция вызывающего не трогается
+    if (!savepoint("hierarchy")) return false;
+    stmt = nullptr;
+    char* err_msg = nullptr;
+    bool ok = sqlite3_exec(conn, "DELETE FROM refs WHERE kind='inherit'; DELETE FROM class_mro; DELETE FROM class_tree;",
+                           nullptr, nullptr, &err_msg) == SQLITE_OK;
+    std::string error = err_msg ? err_msg : "";
+    sqlite3_free(err_msg);
+    touch();
+
+    for (const auto& kv : bases) {
+        for (int parent : kv.second) ok = ok && add_reference(kv.first, parent, "inherit", "");
+    }
+
+    if (ok && sqlite3_prepare_v2(conn, "INSERT INTO class_mro(class_id, pos, base_id) VALUES(?, ?, ?);", -1, &stmt, nullptr) == SQLITE_OK) {
+        for (const auto& kv : memo) {
+            for (size_t pos = 0; ok && pos < kv.second.size(); pos++) {
+                sqlite3_bind_int(stmt, 1, kv.first);
+                sqlite3_bind_int(stmt, 2, (int)pos);
+                sqlite3_bind_int(stmt, 3, kv.second[pos]);
+                ok = sqlite3_step(stmt) == SQLITE_DONE;
+                sqlite3_reset(stmt);
+            }
+        }
+    }
+    if (ok && !stmt) ok = false;
+    if (!ok && error.empty()) error = sqlite3_errmsg(conn);
+    sqlite3_finalize(stmt);
+    stmt = nullptr;
+
+    if (ok && sqlite3_prepare_v2(conn, "INSERT INTO class_tree(class_id, pre, post) VALUES(?, ?, ?);", -1, &stmt, nullptr) == SQLITE_OK) {
+        for (const auto& kv : labels) {
+            if (!ok) break;
+            sqlite3_bind_int(stmt, 1, kv.first);
+            sqlite3_bind_int(stmt, 2, kv.second.first);
+            sqlite3_bind_int(stmt, 3, kv.second.second);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+        }
+    }
+    if (ok && !stmt) ok = false;
+    if (!ok && error.empty()) error = sqlite3_errmsg(conn);
+    sqlite3_finalize(stmt);
+    if (!ok) std::cerr << "fail to write class hierarchy: " << error << "\n";
+
+    ok = release("hierarchy", ok);
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mtx);
+        hierarchy_loaded = false;
+    }
+    load_class_hierarchy();
+    return ok;
+}
+
+void DB::load_class_hierarchy() {
+    std::lock_guard<std::mutex> lock(cache_mtx);
+    if (hierarchy_loaded || !conn) return;
+    hierarchy_loaded = true;
+    mro_cache.clear();
+    ancestors.clear();
+    tree_labels.clear();
+
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(conn, "SELECT class_id, base_id FROM class_mro ORDER BY class_id, pos;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int cls = sqlite3_column_int(stmt, 0);
+            int base = sqlite3_column_int(stmt, 1);
+            mro_cache[cls].push_back(base);
+            ancestors[cls].insert(base);
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    if (sqlite3_prepare_v2(conn, "SELECT class_id, pre, post FROM class_tree;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            tree_labels[sqlite3_column_int(stmt, 0)] = {sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2)};
+        }
+    }
+    sqlite3_finalize(stmt);
+}
+
+bool DB::is_subclass(int class_id, int base_id) {
+    load_class_hierarchy();
+    if (class_id == base_id) return true;
+
+    //по первым базам - вложенность интервалов
+    auto c = tree_labels.find(class_id);
+    auto b = tree_labels.find(base_id);
+    if (c != tree_labels.end() && b != tree_labels.end()
+        && b->second.first <= c->second.first && c->second.second <= b->second.second) {
+        return true;
+    }
+
+    auto it = ancestors.find(class_id);
+    return it != ancestors.end() && it->second.count(base_id);
+}
+
+int DB::resolve_method(const std::string& func_name, int class_id, bool skip_self) {
+    load_class_hierarchy();
+    auto it = mro_cache.find(class_id);
+    if (it == mro_cache.end()) return skip_self ? 0 : get_function_id_by_name_class(func_name, class_id);
+
+    for (size_t i = skip_self ? 1 : 0; i < it->second.size(); i++) {
+        int id = get_function_id_by_name_class(func_name, it->second[i]);
+        if (id) return id;
+    }
+    return 0;
+}
+
+std::vector<std::string> DB::mro(const std::string& class_name) {
+    std::vector<std::string> result;
+    int class_id = get_class_id_by_name(class_name);
+    if (!class_id) return result;
+
+    const char* sql =
+        "SELECT c.name FROM class_mro m "
+        "JOIN classes c ON m.base_id = c.id "
+        "WHERE m.class_id = ? ORDER BY m.pos;";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, class_id);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            result.push_back(name ? name : "");
+        }
+    }
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+std::vector<std::string> DB::subclasses(const std::string& class_name) {
+    std::vector<std::string> result;
+    int class_id = get_class_id_by_name(class_name);
+    if (!class_id) return result;
+
+    const char* sql =
+        "SELECT c.name FROM class_mro m "
+        "JOIN classes c ON m.class_id = c.id "
+        "WHERE m.base_id = ? AND m.pos > 0 ORDER BY c.id;";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, class_id);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            result.push_back(name ? name : "");
+        }
+    }
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+//общий каталог всех файлов проекта
+static std::string common_dir(const std::vector<File>& files) {
+    if (files.empty()) return "";
+    std::string root = files.front().path;
+    size_t slash = root.rfind('/');
+    root = slash != std::string::npos ? root.substr(0, slash + 1) : "";
+    for (const auto& f : files) {
+        while (!root.empty() && f.path.compare(0, root.size(), root) != 0) {
+            root.pop_back();
+            size_t prev = root.rfind('/');
+            root = prev != std::string::npos ? root.substr(0, prev + 1) : "";
+        }
+    }
+    return root;
+}
+
+//каталог над верхним пакетом, в котором лежит dir: a/pkg/sub/ -> a/, если в pkg и sub есть __init__.py
+static std::string package_root(std::string dir, const std::set<std::string>& paths) {
+    while (dir.size() > 1 && paths.count(dir + "__init__.py")) {
+        size_t prev = dir.rfind('/', dir.size() - 2);
+        //пакет - первый компонент относительного пути (test_proj/__init__.py): корень пустой
+        dir = prev != std::string::npos ? dir.substr(0, prev + 1) : "";
+    }
+    return dir;
+}
+
+static std::string project_root(const std::vector<File>& files) {
+    std::set<std::string> paths;
+    for (const auto& f : files) paths.insert(f.path);
+    //если корень сам пакет - поднимаемся, чтобы имя пакета вошло в имя модуля
+    return package_root(common_dir(files), paths);
+}
+
+//путь -> имя модуля относительно корня: pkg/sub/__init__.py -> pkg.sub
+static std::string module_name(const std::string& path, const std::string& root) {
+    std::string rel = path.compare(0, root.size(), root) == 0 ? path.substr(root.size()) : path;
+    if (rel.size() > 3 && rel.compare(rel.size() - 3, 3, ".py") == 0) rel.resize(rel.size() - 3);
+    if (rel == "__init__") return "";
+    if (rel.size() > 9 && rel.compare(rel.size() - 9, 9, "/__init__") == 0) rel.resize(rel.size() - 9);
+    std::replace(rel.begin(), rel.end(), '/', '.');
+    return rel;
+}
+
+static std::string escape_json(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') { out.push_back('\\'); out.push_back(c); }
+        else if (c == '\n') out += "\\n";
+        else if ((unsigned char)c < 0x20) { char buf[8]; snprintf(buf, sizeof(buf), "\\u%04x", c); out += buf; }
+        else out.push_back(c);
+    }
+    return out;
+}
+
+bool DB::create_rollup_graph(const std::string& level, const std::string& output_file) {
+    std::string cache_key = "create_rollup_graph|" + level + "|" + output_file;
+    if (export_cached(cache_key, output_file)) {
+        std::cout << (output_file.size() >= 5 && output_file.compare(output_file.size() - 5, 5, ".json") == 0 ? ".json" : ".dot") << " created: " << output_file << "\n";
+        return true;
+    }
+
+    if (!conn) return false;
+    if (level != "class" && level != "file" && level != "module" && level != "package") {
+        std::cerr << "unknown rollup level: " << level << " (class, file, module, package)\n";
+        return false;
+    }
+
+    std::vector<File> all_files = files();
+    std::string root = project_root(all_files);
+
+    //ключ узла для функции/класса на выбранном уровне
+    auto group_key = [&](const char* path_c, const char* class_c, bool is_init) {
+        std::string path = path_c ? path_c : "";
+        if (level == "file") return path.compare(0, root.size(), root) == 0 ? path.substr(root.size()) : path;
+        std::string mod = module_name(path, root);
+        if (level == "class") {
+            std::string prefix = mod.empty() ? "" : mod + ".";
+            return class_c ? prefix + class_c : (mod.empty() ? std::string("<root>") : mod);
+        }
+        if (level == "package" && !is_init) {
+            size_t dot = mod.rfind('.');
+            mod = dot != std::string::npos ? mod.substr(0, dot) : "";
+        }
+        return mod.empty() ? std::string("<root>") : mod;
+    };
+
+    //вызовы и создания экземпляров, цель - функция или класс
+    //код уровня модуля (from_id = 0) относится к узлу модуля своего файла
+    std::string sql = std::string(
+        "SELECT fl1.path, c1.name, fl2.path, c2.name, COUNT(*) "
+        "FROM refs r "
+        "LEFT JOIN functions f1 ON r.from_id = f1.id "
+        "JOIN files fl1 ON fl1.id = COALESCE(f1.file_id, ") + (has_column(conn, "refs", "file_id") ? "r.file_id" : "NULL") + ") "
+        "LEFT JOIN classes c1 ON f1.class_id = c1.id "
+        "LEFT JOIN functions f2 ON r.kind = 'call' AND r.to_id = f2.id "
+        "LEFT JOIN classes c2 ON c2.id = CASE WHEN r.kind = 'call' THEN f2.class_id ELSE r.to_id END "
+        "JOIN files fl2 ON fl2.id = COALESCE(f2.file_id, c2.file_id) "
+        "WHERE r.kind IN ('call', 'instantiate') "
+        "GROUP BY fl1.id, f1.class_id, fl2.id, c2.id;";
+
+    std::map<std::string, int> nodes;
+    std::map<std::pair<std::string, std::string>, int> edges;
+    auto is_init = [](const char* path) {
+        std::string p = path ? path : "";
+        return p.size() >= 11 && p.compare(p.size() - 11, 11, "__init__.py") == 0;
+    };
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "fail to prepare statement: " << sqlite3_errmsg(conn) << "\n";
+        return false;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* from_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* from_class = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const char* to_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        const char* to_class = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+        int count = sqlite3_column_int(stmt, 4);
+
+        std::string from = group_key(from_path, from_class, is_init(from_path));
+        std::string to = group_key(to_path, to_class, is_init(to_path));
+        nodes[from]; nodes[to];
+        if (from != to) edges[{from, to}] += count;
+    }
+    sqlite3_finalize(stmt);
+
+    std::ofstream ofs(output_file);
+    if (!ofs.is_open()) {
+        std::cerr << "fail to open file: " << output_file << "\n";
+        return false;
+    }
+
+    int next_id = 0;
+    for (auto& kv : nodes) kv.second = next_id++;
+
+    bool json = output_file.size() >= 5 && output_file.compare(output_file.size() - 5, 5, ".json") == 0;
+    if (json) {
+        ofs << "{\"level\": \"" << level << "\", \"nodes\": [";
+        bool first = true;
+        for (const auto& kv : nodes) {
+            ofs << (first ? "" : ", ") << "{\"id\": " << kv.second << ", \"name\": \"" << escape_json(kv.first) << "\"}";
+            first = false;
+        }
+        ofs << "], \"edges\": [";
+        first = true;
+        for (const auto& kv : edges) {
+            ofs << (first ? "" : ", ") << "{\"from\": " << nodes[kv.first.first] << ", \"to\": " << nodes[kv.first.second]
+                << ", \"weight\": " << kv.second << "}";
+            first = false;
+        }
+        ofs << "]}\n";
+    } else {
+        ofs << "digraph Rollup {\n";
+        ofs << "  node [shape=box, style=filled, color=lightblue];\n";
+        for (const auto& kv : nodes) {
+            ofs << "  n" << kv.second << " [label=\"" << escape_dot(kv.first) << "\"];\n";
+        }
+        for (const auto& kv : edges) {
+            ofs << "  n" << nodes[kv.first.first] << " -> n" << nodes[kv.first.second]
+                << " [label=\"" << kv.second << "\", penwidth=" << std::min(1 + kv.second / 10, 8) << "];\n";
+        }
+        ofs << "}\n";
+    }
+    ofs.close();
+    if (!ofs) {
+        std::cerr << "fail to write file: " << output_file << "\n";
+        return false;
+    }
+
+    std::cout << (json ? ".json" : ".dot") << " created: " << output_file << "\n";
+
+    export_done(cache_key, output_file);
+    return true;
+}
+
+void DB::load_module_index() const {
+    std::lock_guard<std::mutex> lock(cache_mtx);
+    if (module_index_loaded || !conn) return;
+    module_index_loaded = true;
+    //после rollback() могли остаться имена откаченных файлов
+    module_index.clear();
+    file_modules.clear();
+    package_files.clear();
+
+    std::vector<File> all_files;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(conn, "SELECT id, path FROM files;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            all_files.push_back({sqlite3_column_int(stmt, 0), path ? path : ""});
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    std::set<std::string> paths;
+    for (const auto& f : all_files) paths.insert(f.path);
+    std::string common = common_dir(all_files);
+    std::string root = package_root(common, paths);
+
+    //абсолютный импорт - только полное имя от корня проекта или от каталога над верхним пакетом файла,
+    //голые имена вложенных файлов не регистрируются: import json не должен найти pkg/util/json.py
+    //при совпадении имен выигрывает модуль ближе к корню
+    std::unordered_map<std::string, size_t> depth;
+    auto add_key = [&](const std::string& key, int file_id) {
+        if (key.empty()) return;
+        size_t parts = std::count(key.begin(), key.end(), '.') + 1;
+        auto it = depth.find(key);
+        if (it == depth.end() || parts < it->second) {
+            depth[key] = parts;
+            module_index[key] = file_id;
+        }
+    };
+    for (const auto& f : all_files) {
+        std::string mod = module_name(f.path, root);
+        file_modules[f.id] = mod;
+        if (f.path.size() >= 11 && f.path.compare(f.path.size() - 11, 11, "__init__.py") == 0) package_files.insert(f.id);
+        add_key(mod, f.id);
+        add_key(module_name(f.path, common), f.id);
+        size_t slash = f.path.rfind('/');
+        std::string dir = slash != std::string::npos ? f.path.substr(0, slash + 1) : "";
+        if (paths.count(dir + "__init__.py")) add_key(module_name(f.path, package_root(dir, paths)), f.id);
+    }
+}
+
+int DB::resolve_module(const std::string& module) const {
+    load_module_index();
+    auto it = module_index.find(module);
+    if (it != module_index.end()) return it->second;
+    //import pkg.missing все равно выполняет pkg/__init__.py: зависимость от ближайшего пакета, но не от модуля
+    std::string key = module;
+    for (size_t dot = key.rfind('.'); dot != std::string::npos; dot = key.rfind('.')) {
+        key.resize(dot);
+        it = module_index.find(key);
+        if (it != module_index.end()) return package_files.count(it->second) ? it->second : 0;
+    }
+    return 0;
+}
+
+int DB::resolve_import(int file_id, const std::string& module, const std::string& name, int level) const {
+    load_module_index();
+    std::string base = module;
+
+    if (level > 0) {
+        //пакет импортирующего файла, затем level-1 уровней вверх
+        auto fit = file_modules.find(file_id);
+        std::string pkg = fit != file_modules.end() ? fit->second : "";
+        bool is_package = package_files.count(file_id) > 0;
+
+        for (int up = is_package ? 1 : 0; up < level; up++) {
+            size_t dot = pkg.rfind('.');
+            pkg = dot != std::string::npos ? pkg.substr(0, dot) : "";
+        }
+        base = pkg.empty() ? module : (module.empty() ? pkg : pkg + "." + module);
+    }
+
+    //from pkg import submodule
+    if (!name.empty()) {
+        auto it = module_index.find(base.empty() ? name : base + "." + name);
+        if (it != module_index.end()) return it->second;
+    }
+    return base.empty() ? 0 : resolve_module(base);
+}
+
+struct ImportGraph {
+    std::vector<int> file_ids;
+    std::vector<std::string> names;
+    std::vector<std::vector<int>> adj;
+};
+
+static ImportGraph load_import_graph(sqlite3* conn, const std::vector<File>& all_files) {
+    ImportGraph g;
+    std::string root = project_root(all_files);
+    std::unordered_map<int, int> index;
+    for (const auto& f : all_files) {
+        index[f.id] = (int)g.file_ids.size();
+        g.file_ids.push_back(f.id);
+        std::string mod = module_name(f.path, root);
+        g.names.push_back(mod.empty() ? f.path : mod);
+    }
+    g.adj.resize(g.file_ids.size());
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT DISTINCT file_id, target_file_id FROM imports WHERE target_file_id > 0;";
+    if (sqlite3_prepare_v2(conn, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            auto from = index.find(sqlite3_column_int(stmt, 0));
+            auto to = index.find(sqlite3_column_int(stmt, 1));
+            if (from != index.end() && to != index.end()) g.adj[from->second].push_back(to->second);
+        }
+    }
+    sqlite3_finalize(stmt);
+    return g;
+}
+
+//итеративный Тарьян, компоненты выдаются в обратном топологическом порядке (зависимости раньше)
+static std::vector<std::vector<int>> tarjan_scc(const std::vector<std::vector<int>>& adj) {
+    int n = (int)adj.size();
+    std::vector<int> idx(n, -1), low(n, 0);
+    std::vector<char> on_stack(n, 0);
+    std::vector<int> stack;
+    std::vector<std::pair<int, size_t>> call;
+    std::vector<std::vector<int>> result;
+    int counter = 0;
+
+    for (int s = 0; s < n; s++) {
+        if (idx[s] != -1) continue;
+        call.push_back({s, 0});
+        idx[s] = low[s] = counter++;
+        stack.push_back(s); on_stack[s] = 1;
+
+        while (!call.empty()) {
+            int v = call.back().first;
+            size_t& i = call.back().second;
+            if (i < adj[v].size()) {
+                int w = adj[v][i++];
+                if (idx[w] == -1) {
+                    idx[w] = low[w] = counter++;
+                    stack.push_back(w); on_stack[w] = 1;
+                    call.push_back({w, 0});
+                } else if (on_stack[w]) {
+                    low[v] = std::min(low[v], idx[w]);
+                }
+                continue;
+            }
+            if (low[v] == idx[v]) {
+                std::vector<int> comp;
+                int w;
+                do {
+                    w = stack.back(); stack.pop_back();
+                    on_stack[w] = 0;
+                    comp.push_back(w);
+                } while (w != v);
+                result.push_back(comp);
+            }
+            call.pop_back();
+            if (!call.empty()) {
+                int parent = call.back().first;
+                low[parent] = std::min(low[parent], low[v]);
+            }
+        }
+    }
+    return result;
+}
+
+static bool is_cycle(const ImportGraph& g, const std::vector<int>& comp) {
+    if (comp.size() > 1) return true;
+    const auto& out = g.adj[comp.front()];
+    return std::find(out.begin(), out.end(), comp.front()) != out.end();
+}
+
+std::vector<std::vector<std::string>> DB::import_cycles() {
+    std::string cache_key = "import_cycles";
+    if (auto hit = cache_get<std::vector<std::vector<std::string>>>(cache_key)) return *hit;
+
+    std::vector<std::vector<std::string>> result;
+    if (!conn) return result;
+
+    ImportGraph g = load_import_graph(conn, files());
+    for (const auto& comp : tarjan_scc(g.adj)) {
+        if (!is_cycle(g, comp)) continue;
+        std::vector<std::string> names;
+        for (int v : comp) names.push_back(g.names[v]);
+        std::sort(names.begin(), names.end());
+        result.push_back(names);
+    }
+    return cache_put(cache_key, result);
+}
+
+std::vector<std::vector<std::string>> DB::import_layers() {
+    std::string cache_key = "import_layers";
+    if (auto hit = cache_get<std::vector<std::vector<std::string>>>(cache_key)) return *hit;
+
+    std::vector<std::vector<std::string>> result;
+    if (!conn) return result;
+
+    ImportGraph g = load_import_graph(conn, files());
+    auto sccs = tarjan_scc(g.adj);
+
+    //слой 0 - модули без проектных зависимостей, цикл целиком в одном слое
+    std::vector<int> comp_of(g.adj.size());
+    for (size_t c = 0; c < sccs.size(); c++) {
+        for (int v : sccs[c]) comp_of[v] = (int)c;
+    }
+    std::vector<int> layer(sccs.size(), 0);
+    for (size_t c = 0; c < sccs.size(); c++) {
+        for (int v : sccs[c]) {
+            for (int w : g.adj[v]) {
+                if (comp_of[w] != (int)c) layer[c] = std::max(layer[c], layer[comp_of[w]] + 1);
+            }
+        }
+        if ((size_t)layer[c] >= result.size()) result.resize(layer[c] + 1);
+        for (int v : sccs[c]) result[layer[c]].push_back(g.names[v]);
+    }
+    for (auto& l : result) std::sort(l.begin(), l.end());
+    return cache_put(cache_key, result);
+}
+
+bool DB::create_import_graph(const std::string& output_file) {
+    std::string cache_key = "create_import_graph|" + output_file;
+    if (export_cached(cache_key, output_file)) {
+        std::cout << ".dot created: " << output_file << "\n";
+        return true;
+    }
+
+    if (!conn) return false;
+
+    ImportGraph g = load_import_graph(conn, files());
+    std::vector<char> in_cycle(g.adj.size(), 0);
+    for (const auto& comp : tarjan_scc(g.adj)) {
+        if (is_cycle(g, comp)) for (int v : comp) in_cycle[v] = 1;
+    }
+
+    std::ofstream ofs(output_file);
+    if (!ofs.is_open()) {
+        std::cerr << "fail to open file: " << output_file << "\n";
+        return false;
+    }
+
+    ofs << "digraph ImportGraph {\n";
+    ofs << "  node [shape=box, style=filled, color=lightblue];\n";
+    for (size_t v = 0; v < g.adj.size(); v++) {
+        ofs << "  " << g.file_ids[v] << " [label=\"" << escape_dot(g.names[v]) << "\"" << (in_cycle[v] ? ", color=salmon" : "") << "];\n";
+    }
+    for (size_t v = 0; v < g.adj.size(); v++) {
+        for (int w : g.adj[v]) {
+            ofs << "  " << g.file_ids[v] << " -> " << g.file_ids[w] << (in_cycle[v] && in_cycle[w] ? " [color=red]" : "") << ";\n";
+        }
+    }
+    ofs << "}\n";
+    ofs.close();
+    if (!ofs) {
+        std::cerr << "fail to write file: " << output_file << "\n";
+        return false;
+    }
+
+    std::cout << ".dot created: " << output_file << "\n";
+
+    export_done(cache_key, output_file);
+    return true;
+}
+
+DBPool::DBPool(const std::string& path, size_t size, OpenMode mode)
+    : path(path), mode(mode), max_size(size ? size : 1) {}
+
+std::shared_ptr<DB> DBPool::acquire() {
+    std::unique_ptr<DB> db;
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&] { return !idle.empty() || created < max_size; });
+        if (!idle.empty()) {
+            db = std::move(idle.back());
+            idle.pop_back();
+        } else {
+            created++;
+        }
+    }
+    //новое соединение открывается вне блокировки
+    if (!db) db.reset(new DB(path, mode));
+
+    auto self = shared_from_this();
+    return std::shared_ptr<DB>(db.release(), [self](DB* d) { self->release(d); });
+}
+
+void DBPool::release(DB* db) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        idle.emplace_back(db);
+    }
+    cv.notify_one();
+}
+
+int32_t StringDict::code(const char* s) {
+    std::string_view key = s ? s : "";
+    auto it = index.find(key);
+    if (it != index.end()) return it->second;
+    //deque не перемещает элементы, string_view в индексе остаются валидными
+    values.emplace_back(key);
+    int32_t id = (int32_t)values.size() - 1;
+    index.emplace(values.back(), id);
+    return id;
+}
+
+Column& ColumnTable::add_column(const std::string& name, bool dict_encoded) {
+    columns.push_back(std::make_shared<Column>(Column{name, dict_encoded, {}}));
+    return *columns.back();
+}
+
+std::shared_ptr<Column> ColumnTable::column(const std::string& name) const {
+    for (const auto& c : columns) {
+        if (c->name == name) return c;
+    }
+    return nullptr;
+}
+
+//резерв под число строк, чтобы колонки не перевыделялись
+static size_t count_rows(sqlite3* conn, const char* table) {
+    size_t n = 0;
+    sqlite3_stmt* stmt;
+    std::string sql = std::string("SELECT MAX(id) FROM ") + table + ";";
+    if (sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        n = (size_t)sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return n;
+}
+
+ColumnTable DB::files_columns() {
+    ColumnTable t;
+    if (!conn) return t;
+    Column& id = t.add_column("id");
+    Column& path = t.add_column("path", true);
+
+    size_t n = count_rows(conn, "files");
+    id.data.reserve(n); path.data.reserve(n);
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(conn, "SELECT id, path FROM files;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            id.data.push_back(sqlite3_column_int(stmt, 0));
+            path.data.push_back(t.dict->code(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1))));
+        }
+    }
+    sqlite3_finalize(stmt);
+    return t;
+}
+
+ColumnTable DB::refs_columns() {
+    ColumnTable t;
+    if (!conn) return t;
+    Column& id = t.add_column("id");
+    Column& from = t.add_column("from_id");
+    Column& to = t.add_column("to_id");
+    Column& line = t.add_column("line");
+    Column& kind = t.add_column("kind", true);
+
+    size_t n = count_rows(conn, "refs");
+    for (auto& c : t.columns) c->data.reserve(n);
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(conn, "SELECT id, from_id, to_id, line, kind FROM refs;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            id.data.push_back(sqlite3_column_int(stmt, 0));
+            from.data.push_back(sqlite3_column_int(stmt, 1));
+            to.data.push_back(sqlite3_column_int(stmt, 2));
+            line.data.push_back(sqlite3_column_int(stmt, 3));
+            kind.data.push_back(t.dict->code(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4))));
+        }
+    }
+    sqlite3_finalize(stmt);
+    return t;
+}
+
+ColumnTable DB::imports_columns() {
+    ColumnTable t;
+    if (!conn) return t;
+    Column& file_id = t.add_column("file_id");
+    Column& target = t.add_column("target_file_id");
+    Column& module = t.add_column("module", true);
+    Column& name = t.add_column("name", true);
+
+    size_t n = count_rows(conn, "imports");
+    for (auto& c : t.columns) c->data.reserve(n);
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(conn, "SELECT file_id, target_file_id, module, name FROM imports;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            file_id.data.push_back(sqlite3_column_int(stmt, 0));
+            target.data.push_back(sqlite3_column_int(stmt, 1));
+            module.data.push_back(t.dict->code(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2))));
+            name.data.push_back(t.dict->code(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3))));
+        }
+    }
+    sqlite3_finalize(stmt);
+    return t;
+}
+
+ColumnTable DB::dangerous_columns(const QueryFilter& filter) {
+    ColumnTable t;
+    if (!conn) return t;
+    Column& function = t.add_column("function", true);
+    Column& from = t.add_column("from", true);
+    Column& line = t.add_column("line");
+    Column& file = t.add_column("file", true);
+
+    scan_dangerous(prepare_dangerous(filter), filter, [&](const DangerousCall& dc) {
+        function.data.push_back(t.dict->code(dc.function.c_str()));
+        from.data.push_back(t.dict->code(dc.from.c_str()));
+        line.data.push_back(dc.line);
+        file.data.push_back(t.dict->code(dc.file.c_str()));
+    });
+    return t;
+}
+
+static bool ref_from_row(sqlite3_stmt* stmt, Reference& r) {
+    const char* kind = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+    const char* args = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+    r.id = sqlite3_column_int(stmt, 0);
+    r.from_id = sqlite3_column_int(stmt, 1);
+    r.to_id = sqlite3_column_int(stmt, 2);
+    r.kind = kind ? kind : "";
+    r.args = args ? args : "";
+    r.line = sqlite3_column_int(stmt, 5);
+    return true;
+}
+
+static bool import_from_row(sqlite3_stmt* stmt, Import& imp) {
+    const char* module = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+    imp.file_id = sqlite3_column_int(stmt, 0);
+    imp.module = module ? module : "";
+    imp.name = name ? name : "";
+    imp.target_file_id = sqlite3_column_int(stmt, 3);
+    return true;
+}
+
+std::unique_ptr<Cursor<Reference>> DB::iter_refs(size_t chunk_size) {
+    sqlite3_stmt* stmt = nullptr;
+    if (conn && sqlite3_prepare_v2(conn, "SELECT id, from_id, to_id, kind, args, line FROM refs;", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "fail to prepare statement: " << sqlite3_errmsg(conn) << "\n";
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+    }
+    return std::make_unique<Cursor<Reference>>(stmt, ref_from_row, chunk_size);
+}
+
+std::unique_ptr<Cursor<Import>> DB::iter_imports(size_t chunk_size) {
+    sqlite3_stmt* stmt = nullptr;
+    if (conn && sqlite3_prepare_v2(conn, "SELECT file_id, module, name, target_file_id FROM imports;", -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "fail to prepare statement: " << sqlite3_errmsg(conn) << "\n";
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+    }
+    return std::make_unique<Cursor<Import>>(stmt, import_from_row, chunk_size);
+}
+
+std::unique_ptr<Cursor<DangerousCall>> DB::iter_dangerous(size_t chunk_size, const QueryFilter& filter) {
+    return std::make_unique<Cursor<DangerousCall>>(prepare_dangerous(filter), dangerous_from_row, chunk_size);
+}
+
+static std::string to_lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+static std::set<std::string> trigrams(const std::string& s) {
+    std::set<std::string> out;
+    for (size_t i = 0; i + 3 <= s.size(); i++) out.insert(s.substr(i, 3));
+    return out;
+}
+
+//фраза fts5: кавычки удваиваются
+static std::string fts_phrase(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+bool DB::build_symbol_index() {
+    if (!conn) return false;
+    load_module_index();
+    //внутри транзакции индексации откатывается вместе с ней
+    if (!savepoint("symbols")) return false;
+
+    //производные таблицы, пересоздаются целиком
+    const char* schema =
+        "DROP TABLE IF EXISTS symbols_fts;"
+        "DROP TABLE IF EXISTS symbol_grams;"
+        "DROP TABLE IF EXISTS symbols;"
+        "CREATE TABLE symbols(id INTEGER PRIMARY KEY, kind TEXT, name TEXT, lname TEXT, "
+        "qualified TEXT, path TEXT, line INTEGER, search TEXT);"
+        "CREATE INDEX symbols_lname ON symbols(lname);"
+        "CREATE TABLE symbol_grams(gram TEXT PRIMARY KEY, docs INTEGER) WITHOUT ROWID;";
+    char* err_msg = nullptr;
+    if (sqlite3_exec(conn, schema, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cerr << "SQL error: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        release("symbols", false);
+        return false;
+    }
+
+    bool ok = true;
+    sqlite3_stmt* ins = nullptr;
+    if (sqlite3_prepare_v2(conn, "INSERT INTO symbols(kind, name, lname, qualified, path, line, search) VALUES(?, ?, lower(?2), ?, ?, ?, ?);", -1, &ins, nullptr) != SQLITE_OK) {
+        std::cerr << "fail to prepare statement: " << sqlite3_errmsg(conn) << "\n";
+        release("symbols", false);
+        return false;
+    }
+    //частоты триграмм для отбора кандидатов нечеткого поиска
+    std::unordered_map<std::string, int> gram_docs;
+    //search - текст для fts, путь только у файлов, иначе индекс раздувается в разы
+    auto add = [&](const char* kind, const std::string& name, const std::string& qualified, const std::string& path, int line, const std::string& search) {
+        sqlite3_bind_text(ins, 1, kind, -1, SQLITE_STATIC);
+        sqlite3_bind_text(ins, 2, name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(ins, 3, qualified.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(ins, 4, path.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(ins, 5, line);
+        sqlite3_bind_text(ins, 6, search.c_str(), -1, SQLITE_TRANSIENT);
+        ok = sqlite3_step(ins) == SQLITE_DONE && ok;
+        sqlite3_reset(ins);
+        for (const auto& g : trigrams(to_lower(search))) gram_docs[g]++;
+    };
+    auto qualify = [&](int file_id, const std::string& name) {
+        auto it = file_modules.find(file_id);
+        return (it == file_modules.end() || it->second.empty()) ? name : it->second + "." + name;
+    };
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(conn, "SELECT id, path FROM files;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* p = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            std::string path = p ? p : "";
+            auto it = file_modules.find(sqlite3_column_int(stmt, 0));
+            std::string mod = it != file_modules.end() ? it->second : "";
+            add("file", path.substr(path.find_last_of('/') + 1), mod.empty() ? path : mod, path, 0, mod + " " + path);
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    const char* classes_sql = "SELECT c.name, c.file_id, c.start_line, fl.path FROM classes c JOIN files fl ON c.file_id = fl.id;";
+    if (sqlite3_prepare_v2(conn, classes_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* n = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            const char* p = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            if (!n) continue;
+            std::string name = n;
+            std::string qualified = qualify(sqlite3_column_int(stmt, 1), name);
+            add("class", name, qualified, p ? p : "", sqlite3_column_int(stmt, 2), qualified);
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    const char* funcs_sql =
+        "SELECT f.name, c.name, f.file_id, f.start_line, fl.path FROM functions f "
+        "LEFT JOIN classes c ON f.class_id = c.id JOIN files fl ON f.file_id = fl.id;";
+    if (sqlite3_prepare_v2(conn, funcs_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* n = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            const char* cls = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            const char* p = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+            if (!n) continue;
+            std::string name = n;
+            std::string local = cls ? std::string(cls) + "." + name : name;
+            std::string qualified = qualify(sqlite3_column_int(stmt, 2), local);
+            add(cls ? "method" : "function", name, qualified, p ? p : "", sqlite3_column_int(stmt, 3), qualified);
+        }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(ins);
+
+    if (sqlite3_prepare_v2(conn, "INSERT INTO symbol_grams(gram, docs) VALUES(?, ?);", -1, &stmt, nullptr) == SQLITE_OK) {
+        for (const auto& kv : gram_docs) {
+            sqlite3_bind_text(stmt, 1, kv.first.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 2, kv.second);
+            ok = sqlite3_step(stmt) == SQLITE_DONE && ok;
+            sqlite3_reset(stmt);
+        }
+    } else {
+        ok = false;
+    }
+    sqlite3_finalize(stmt);
+    if (!ok) {
+        std::cerr << "fail to write symbol index: " << sqlite3_errmsg(conn) << "\n";
+        release("symbols", false);
+        return false;
+    }
+
+    //без fts5 search работает через LIKE
+    const char* fts =
+        "CREATE VIRTUAL TABLE symbols_fts USING fts5(search, content='symbols', content_rowid='id', tokenize='trigram');"
+        "INSERT INTO symbols_fts(symbols_fts) VALUES('rebuild');";
+    if (sqlite3_exec(conn, fts, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        std::cerr << "fts5 trigram index unavailable: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+    }
+    touch();
+    return release("symbols", true);
+}
+
+std::vector<SymbolMatch> DB::search(const std::string& query, const std::string& kind, int limit) {
+    std::vector<SymbolMatch> result;
+    if (!conn || query.empty() || limit <= 0) return result;
+
+    std::string q = to_lower(query);
+    std::set<std::string> q_grams = trigrams(q);
+    std::unordered_map<int, SymbolMatch> found;
+
+    //exact > prefix имени > подстрока имени > подстрока qualified/path > похожесть по триграммам
+    auto score = [&](const SymbolMatch& m, bool fuzzy) {
+        std::string name = to_lower(m.name);
+        double tie = 1.0 / (1.0 + m.qualified.size());
+        if (name == q) return 4.0 + tie;
+        if (name.compare(0, q.size(), q) == 0) return 3.0 + tie;
+        if (name.find(q) != std::string::npos) return 2.0 + tie;
+        if (!fuzzy) return 1.0 + tie;
+        std::string qualified = to_lower(m.qualified);
+        size_t common = 0;
+        for (const auto& g : q_grams) common += qualified.find(g) != std::string::npos;
+        size_t grams = qualified.size() > 2 ? qualified.size() - 2 : 1;
+        return (double)common / (q_grams.size() + grams - std::min(common, grams)) + tie * 0.01;
+    };
+
+    auto collect = [&](const std::string& sql, const std::vector<std::string>& params, bool fuzzy, int rows) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(conn, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            sqlite3_finalize(stmt);
+            return false;
+        }
+        int i = 1;
+        for (const auto& p : params) sqlite3_bind_text(stmt, i++, p.c_str(), -1, SQLITE_TRANSIENT);
+        if (!kind.empty()) sqlite3_bind_text(stmt, i++, kind.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, i, rows);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int id = sqlite3_column_int(stmt, 0);
+            if (found.count(id)) continue;
+            const char* kind_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            const char* name_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            const char* qualified_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+            const char* file_c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+            SymbolMatch m;
+            m.kind = kind_c ? kind_c : "";
+            m.name = name_c ? name_c : "";
+            m.qualified = qualified_c ? qualified_c : "";
+            m.file = file_c ? file_c : "";
+            m.line = sqlite3_column_int(stmt, 5);
+            m.score = score(m, fuzzy);
+            found[id] = m;
+        }
+        sqlite3_finalize(stmt);
+        return true;
+    };
+
+    const std::string cols = "SELECT s.id, s.kind, s.name, s.qualified, s.path, s.line FROM ";
+    const std::string kind_sql = kind.empty() ? "" : " AND s.kind = ?";
+
+    //префикс по индексу symbols_lname
+    collect(cols + "symbols s WHERE s.lname >= ? AND s.lname < ?" + kind_sql + " ORDER BY s.lname LIMIT ?;", {q, q + "\xff"}, false, limit * 4);
+
+    if (q.size() >= 3) {
+        //частоты триграмм запроса; нет таблицы - индекс без fts, только LIKE
+        std::vector<std::pair<int, std::string>> freq;
+        sqlite3_stmt* stmt;
+        bool has_fts = sqlite3_prepare_v2(conn, "SELECT docs FROM symbol_grams WHERE gram = ?;", -1, &stmt, nullptr) == SQLITE_OK;
+        if (has_fts) {
+            for (const auto& g : q_grams) {
+                sqlite3_bind_text(stmt, 1, g.c_str(), -1, SQLITE_TRANSIENT);
+                if (sqlite3_step(stmt) == SQLITE_ROW) freq.push_back({sqlite3_column_int(stmt, 0), g});
+                sqlite3_reset(stmt);
+            }
+        }
+        sqlite3_finalize(stmt);
+        std::sort(freq.begin(), freq.end());
+
+        //если какой-то триграммы нет ни в одном символе, подстроки тоже нет,
+        //а фраза из частых триграмм (fn_, get) стоила бы обхода их длинных списков
+        if (has_fts && freq.size() == q_grams.size()) {
+            has_fts = collect(cols + "symbols_fts JOIN symbols s ON s.id = symbols_fts.rowid WHERE symbols_fts MATCH ?" + kind_sql + " LIMIT ?;", {fts_phrase(q)}, false, limit * 4);
+        }
+        if (!has_fts) {
+            collect(cols + "symbols s WHERE s.search LIKE ?" + kind_sql + " LIMIT ?;", {"%" + q + "%"}, false, limit * 4);
+        } else if (found.empty()) {
+            //опечатки: кандидаты по самым редким триграммам в пределах бюджета строк
+            const int budget = 1000;
+            std::string any;
+            int total = 0;
+            for (const auto& fg : freq) {
+                if (!any.empty() && total + fg.first > budget) break;
+                any += (any.empty() ? "" : " OR ") + fts_phrase(fg.second);
+                total += fg.first;
+            }
+            if (!any.empty()) {
+                collect(cols + "symbols_fts JOIN symbols s ON s.id = symbols_fts.rowid WHERE symbols_fts MATCH ?" + kind_sql + " LIMIT ?;", {any}, true, budget);
+            }
+        }
+    }
+
+    for (auto& kv : found) result.push_back(std::move(kv.second));
+    std::sort(result.begin(), result.end(), [](const SymbolMatch& a, const SymbolMatch& b) {
+        if (a.score != b.score) return a.score > b.score;
+        return a.qualified < b.qualified;
+    });
+    if ((int)result.size() > limit) result.resize(limit);
+    return result;
+}
+
+long long DB::meta_value(const char* key) {
+    if (!conn) return -1;
+    sqlite3_stmt* stmt;
+    long long value = -1;
+    if (sqlite3_prepare_v2(conn, "SELECT value FROM meta WHERE key = ?;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, key, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) value = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+long long DB::write_version() {
+    return meta_value("write_version");
+}
+
+//файл экспорта в момент записи; другой путь от другого cwd, перезапись или правка дают другой отпечаток
+struct ExportStamp {
+    std::string path;
+    long long size = -1;
+    long long mtime_ns = -1;
+    bool operator==(const ExportStamp& o) const { return path == o.path && size == o.size && mtime_ns == o.mtime_ns; }
+};
+
+static ExportStamp export_stamp(const std::string& output) {
+    ExportStamp stamp;
+    std::error_code ec;
+    stamp.path = std::filesystem::absolute(output, ec).string();
+    struct stat st;
+    if (stat(output.c_str(), &st) != 0) return stamp;
+    stamp.size = st.st_size;
+    stamp.mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return stamp;
+}
+
+//без таблицы meta (старая БД только на чтение) кэш отключен
+bool DB::cache_lookup(const std::string& key, std::any& value) {
+    long long version = write_version();
+    std::lock_guard<std::mutex> lock(result_mtx);
+    cache_counters.version = version;
+    auto it = result_cache.find(key);
+    bool hit = version >= 0 && !version_dirty && it != result_cache.end() && it->second.first == version;
+    if (hit) {
+        cache_counters.hits++;
+        value = it->second.second;
+    } else {
+        cache_counters.misses++;
+    }
+    return hit;
+}
+
+void DB::cache_store(const std::string& key, std::any value) {
+    long long version = write_version();
+    if (version < 0 || version_dirty) return;
+    std::lock_guard<std::mutex> lock(result_mtx);
+    result_cache[key] = {version, std::move(value)};
+}
+
+bool DB::export_cached(const std::string& key, const std::string& output) {
+    auto hit = cache_get<ExportStamp>(key);
+    if (!hit) return false;
+    if (hit->size >= 0 && *hit == export_stamp(output)) return true;
+    //запись есть, но файл уже не тот - это промах
+    std::lock_guard<std::mutex> lock(result_mtx);
+    cache_counters.hits--;
+    cache_counters.misses++;
+    return false;
+}
+
+void DB::export_done(const std::string& key, const std::string& output) {
+    ExportStamp stamp = export_stamp(output);
+    if (stamp.size >= 0) cache_put(key, stamp);
+}
+
+CacheStats DB::cache_stats() const {
+    std::lock_guard<std::mutex> lock(result_mtx);
+    CacheStats stats = cache_counters;
+    stats.entries = result_cache.size();
+    return stats;
+}
+
+void DB::clear_cache() {
+    std::lock_guard<std::mutex> lock(result_mtx);
+    result_cache.clear();
+    cache_counters = CacheStats();
+}
+
+//сериализация значений кэша для файла
+static void write_value(std::ostream& os, int v) { os.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+static void write_value(std::ostream& os, long long v) { os.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+static void write_value(std::ostream& os, bool v) { os.put(v ? 1 : 0); }
+static void write_value(std::ostream& os, const std::string& v) {
+    write_value(os, (int)v.size());
+    os.write(v.data(), v.size());
+}
+static void write_value(std::ostream& os, const File& v) { write_value(os, v.id); write_value(os, v.path); }
+static void write_value(std::ostream& os, const Import& v) {
+    write_value(os, v.file_id); write_value(os, v.module); write_value(os, v.name); write_value(os, v.target_file_id);
+}
+static void write_value(std::ostream& os, const DangerousCall& v) {
+    write_value(os, v.function); write_value(os, v.from); write_value(os, v.line); write_value(os, v.file);
+}
+static void write_value(std::ostream& os, const PathHop& v) { write_value(os, v.function); write_value(os, v.file); write_value(os, v.line); }
+static void write_value(std::ostream& os, const DeadSymbol& v) {
+    write_value(os, v.kind); write_value(os, v.name); write_value(os, v.file); write_value(os, v.start_line); write_value(os, v.end_line);
+}
+template <typename T>
+static void write_value(std::ostream& os, const std::vector<T>& v) {
+    write_value(os, (int)v.size());
+    for (const auto& item : v) write_value(os, item);
+}
+static void write_value(std::ostream& os, const DangerousPath& v) { write_value(os, v.sink); write_value(os, v.entry); write_value(os, v.hops); }
+static void write_value(std::ostream& os, const ExportStamp& v) { write_value(os, v.path); write_value(os, v.size); write_value(os, v.mtime_ns); }
+static void write_value(std::ostream& os, const DangerousGraph::Sink& v) { write_value(os, v.from); write_value(os, v.name); write_value(os, v.line); }
+static void write_value(std::ostream& os, const std::shared_ptr<const DangerousGraph>& v) {
+    write_value(os, v->nodes); write_value(os, v->edge_start); write_value(os, v->edge_to); write_value(os, v->edge_line); write_value(os, v->sinks);
+}
+
+static void read_value(std::istream& is, int& v) { is.read(reinterpret_cast<char*>(&v), sizeof(v)); }
+static void read_value(std::istream& is, long long& v) { is.read(reinterpret_cast<char*>(&v), sizeof(v)); }
+static void read_value(std::istream& is, bool& v) { v = is.get() == 1; }
+static void read_value(std::istream& is, std::string& v) {
+    int n = 0;
+    read_value(is, n);
+    if (!is || n < 0) { is.setstate(std::ios::failbit); return; }
+    v.resize(n);
+    is.read(&v[0], n);
+}
+static void read_value(std::istream& is, File& v) { read_value(is, v.id); read_value(is, v.path); }
+static void read_value(std::istream& is, Import& v) {
+    read_value(is, v.file_id); read_value(is, v.module); read_value(is, v.name); read_value(is, v.target_file_id);
+}
+static void read_value(std::istream& is, DangerousCall& v) {
+    read_value(is, v.function); read_value(is, v.from); read_value(is, v.line); read_value(is, v.file);
+}
+static void read_value(std::istream& is, PathHop& v) { read_value(is, v.function); read_value(is, v.file); read_value(is, v.line); }
+static void read_value(std::istream& is, DeadSymbol& v) {
+    read_value(is, v.kind); read_value(is, v.name); read_value(is, v.file); read_value(is, v.start_line); read_value(is, v.end_line);
+}
+template <typename T>
+static void read_value(std::istream& is, std::vector<T>& v) {
+    int n = 0;
+    read_value(is, n);
+    if (!is || n < 0) { is.setstate(std::ios::failbit); return; }
+    v.clear();
+    for (int i = 0; i < n && is; i++) {
+        T item{};
+        read_value(is, item);
+        v.push_back(std::move(item));
+    }
+}
+static void read_value(std::istream& is, DangerousPath& v) { read_value(is, v.sink); read_value(is, v.entry); read_value(is, v.hops); }
+static void read_value(std::istream& is, ExportStamp& v) { read_value(is, v.path); read_value(is, v.size); read_value(is, v.mtime_ns); }
+static void read_value(std::istream& is, DangerousGraph::Sink& v) { read_value(is, v.from); read_value(is, v.name); read_value(is, v.line); }
+static void read_value(std::istream& is, std::shared_ptr<const DangerousGraph>& v) {
+    auto g = std::make_shared<DangerousGraph>();
+    read_value(is, g->nodes); read_value(is, g->edge_start); read_value(is, g->edge_to); read_value(is, g->edge_line); read_value(is, g->sinks);
+    //индексы из файла не должны выходить за граф
+    size_t n = g->nodes.size();
+    bool ok = g->edge_start.size() == n + 1 && g->edge_to.size() == g->edge_line.size();
+    for (size_t i = 0; ok && i <= n; i++) {
+        ok = g->edge_start[i] >= 0 && (size_t)g->edge_start[i] <= g->edge_to.size() && (i == 0 || g->edge_start[i] >= g->edge_start[i - 1]);
+    }
+    for (size_t i = 0; ok && i < g->edge_to.size(); i++) ok = g->edge_to[i] >= 0 && (size_t)g->edge_to[i] < n;
+    for (size_t i = 0; ok && i < g->sinks.size(); i++) ok = g->sinks[i].from >= 0 && (size_t)g->sinks[i].from < n;
+    if (!ok) is.setstate(std::ios::failbit);
+    v = g;
+}
+
+//типы значений кэша, индекс в списке пишется в файл
+struct CacheCodec {
+    const std::type_info& type;
+    std::function<void(std::ostream&, const std::any&)> save;
+    std::function<std::any(std::istream&)> load;
+};
+
+template <typename T>
+static CacheCodec cache_codec() {
+    return {typeid(T),
+            [](std::ostream& os, const std::any& v) { write_value(os, std::any_cast<const T&>(v)); },
+            [](std::istream& is) { T v{}; read_value(is, v); return std::any(std::move(v)); }};
+}
+
+static const std::vector<CacheCodec>& cache_codecs() {
+    static const std::vector<CacheCodec> codecs = {
+        cache_codec<bool>(),
+        cache_codec<std::vector<File>>(),
+        cache_codec<std::vector<Import>>(),
+        cache_codec<std::vector<DangerousCall>>(),
+        cache_codec<std::vector<DangerousPath>>(),
+        cache_codec<std::vector<DeadSymbol>>(),
+        cache_codec<std::vector<std::vector<std::string>>>(),
+        cache_codec<ExportStamp>(),
+        cache_codec<std::shared_ptr<const DangerousGraph>>(),
+    };
+    return codecs;
+}
+
+static const char CACHE_MAGIC[8] = {'M', 'Y', 'U', 'C', 'A', 'C', 'H', '3'};
+
+bool DB::save_cache(const std::string& path) {
+    std::string out_path = path.empty() ? db_path + ".cache" : path;
+    long long version = write_version();
+    long long generation = meta_value("generation");
+    if (version < 0 || generation == -1) return false;
+
+    std::string tmp = out_path + ".tmp";
+    std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+    if (!os.is_open()) return false;
+    os.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    os.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    os.write(reinterpret_cast<const char*>(&generation), sizeof(generation));
+    {
+        std::lock_guard<std::mutex> lock(result_mtx);
+        const auto& codecs = cache_codecs();
+        for (const auto& kv : result_cache) {
+            if (kv.second.first != version) continue;
+            for (size_t c = 0; c < codecs.size(); c++) {
+                if (kv.second.second.type() != codecs[c].type) continue;
+                os.put((char)c);
+                write_value(os, kv.first);
+                codecs[c].save(os, kv.second.second);
+                break;
+            }
+        }
+    }
+    os.close();
+    if (!os) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return std::rename(tmp.c_str(), out_path.c_str()) == 0;
+}
+
+bool DB::load_cache(const std::string& path) {
+    std::ifstream is(path.empty() ? db_path + ".cache" : path, std::ios::binary);
+    if (!is.is_open()) return false;
+
+    char magic[sizeof(CACHE_MAGIC)];
+    long long version = -1;
+    long long generation = -1;
+    is.read(magic, sizeof(magic));
+    is.read(reinterpret_cast<char*>(&version), sizeof(version));
+    is.read(reinterpret_cast<char*>(&generation), sizeof(generation));
+    //файл от другой версии данных или от другой/пересобранной БД не используется
+    if (!is || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 || version != write_version() || version < 0 ||
+        generation == -1 || generation != meta_value("generation")) return false;
+
+    const auto& codecs = cache_codecs();
+    std::lock_guard<std::mutex> lock(result_mtx);
+    for (int c = is.get(); c != EOF; c = is.get()) {
+        if ((size_t)c >= codecs.size()) return false;
+        std::string key;
+        read_value(is, key);
+        std::any value = codecs[c].load(is);
+        if (!is) return false;
+        result_cache[key] = {version, std::move(value)};
+    }
+    return true;
+}
+
+void DB::persist_cache(const std::string& path) {
+    cache_file = path.empty() ? db_path + ".cache" : path;
+    load_cache(cache_file);
 }
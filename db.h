@@ -3,7 +3,16 @@
 #include <vector>
 #include <sqlite3.h>
 #include <unordered_set>
+#include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <string_view>
+#include <cstdint>
+#include <any>
+#include <optional>
 
 
 struct File {
@@ -25,6 +34,8 @@ struct Reference {
     int from_id;
     int to_id;
     std::string kind;
+    std::string args;
+    int line;
 };
 
 struct Class {
@@ -45,15 +56,11 @@ struct ClassEdge {
     int to;
 };
 
-struct FuncInfo {
-    std::string name;
-    std::string class_name;
-};
-
 struct Import {
     int file_id;
     std::string module;
     std::string name;
+    int target_file_id;
 };
 
 struct DangerousCall {
@@ -63,34 +70,317 @@ struct DangerousCall {
     std::string file;
 };
 
+struct PathHop {
+    std::string function;
+    std::string file;
+    int line;
+};
+
+struct DangerousPath {
+    std::string sink;
+    std::string entry;
+    std::vector<PathHop> hops;
+};
+
+//граф вызовов для get_dangerous_paths, определен в db.cpp
+struct DangerousGraph;
+
+struct DeadSymbol {
+    std::string kind;
+    std::string name;
+    std::string file;
+    int start_line;
+    int end_line;
+};
+
+//статистика кэша результатов запросов
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t entries = 0;
+    long long version = 0;
+
+    double hit_rate() const { return hits + misses ? (double)hits / (hits + misses) : 0.0; }
+};
+
+//результат поиска символа, score больше - выше в выдаче
+struct SymbolMatch {
+    std::string kind;
+    std::string name;
+    std::string qualified;
+    std::string file;
+    int line;
+    double score;
+};
+
+//фильтры запросов, компилируются в параметризованный WHERE
+//пустое поле - без ограничения; line_* только для get_dangerous, module_prefix только для импортов
+struct QueryFilter {
+    std::string path_prefix;
+    std::string path_glob;
+    std::vector<int> file_ids;
+    std::string module_prefix;
+    std::vector<std::string> sinks;
+    int line_min = 0;
+    int line_max = 0;
+    int limit = -1;
+    int offset = 0;
+};
+
+//словарь строк, общий для всех строковых колонок таблицы
+struct StringDict {
+    std::deque<std::string> values;
+    std::unordered_map<std::string_view, int32_t> index;
+
+    int32_t code(const char* s);
+    size_t size() const { return values.size(); }
+};
+
+struct Column {
+    std::string name;
+    bool dict_encoded;
+    std::vector<int32_t> data;
+};
+
+//колоночный результат: int32 колонки, строки как коды в общем словаре
+struct ColumnTable {
+    std::vector<std::shared_ptr<Column>> columns;
+    std::shared_ptr<StringDict> dict = std::make_shared<StringDict>();
+
+    Column& add_column(const std::string& name, bool dict_encoded = false);
+    std::shared_ptr<Column> column(const std::string& name) const;
+    size_t rows() const { return columns.empty() ? 0 : columns.front()->data.size(); }
+};
+
+//курсор по результату запроса, строки читаются порциями по мере итерации
+template <typename Row>
+class Cursor {
+public:
+    using Decoder = bool (*)(sqlite3_stmt*, Row&);
+
+    Cursor(sqlite3_stmt* stmt, Decoder decode, size_t chunk_size = 1024)
+        : stmt(stmt), decode(decode), chunk_size(chunk_size ? chunk_size : 1) {}
+    ~Cursor() { if (stmt) sqlite3_finalize(stmt); }
+    Cursor(const Cursor&) = delete;
+    Cursor& operator=(const Cursor&) = delete;
+
+    //fill/pop сами не синхронизированы, курсор из нескольких потоков - под этим мьютексом
+    std::mutex& mutex() { return mtx; }
+
+    //следующая порция строк в буфер, 0 - данные закончились
+    size_t fill() {
+        buffer.clear();
+        pos = 0;
+        Row row;
+        while (stmt && buffer.size() < chunk_size) {
+            if (sqlite3_step(stmt) != SQLITE_ROW) {
+                sqlite3_finalize(stmt);
+                stmt = nullptr;
+                break;
+            }
+            if (decode(stmt, row)) buffer.push_back(std::move(row));
+        }
+        return buffer.size();
+    }
+
+    size_t buffered() const { return buffer.size() - pos; }
+
+    bool pop(Row& out) {
+        if (pos >= buffer.size()) return false;
+        out = std::move(buffer[pos++]);
+        return true;
+    }
+
+    bool next(Row& out) {
+        if (!buffered() && !fill()) return false;
+        return pop(out);
+    }
+
+private:
+    sqlite3_stmt* stmt;
+    Decoder decode;
+    size_t chunk_size;
+    std::vector<Row> buffer;
+    size_t pos = 0;
+    std::mutex mtx;
+};
+
+//READ_ONLY/IMMUTABLE - для отчетов, IMMUTABLE если файл гарантированно не меняется
+enum class OpenMode {
+    READ_WRITE,
+    READ_ONLY,
+    IMMUTABLE
+};
+
+//догоняет схему старой БД до текущей (ALTER TABLE), версия в meta.schema_version
+bool upgrade_schema(sqlite3* conn);
+
 class DB {
 private:
     sqlite3* conn;
+    std::string db_path;
+    OpenMode open_mode;
+    mutable std::mutex cache_mtx;
+
+    //иерархия классов: mro (включая сам класс), множество предков и метки эйлерова обхода по первым базам
+    std::unordered_map<int, std::vector<int>> mro_cache;
+    std::unordered_map<int, std::unordered_set<int>> ancestors;
+    std::unordered_map<int, std::pair<int, int>> tree_labels;
+    bool hierarchy_loaded = false;
+
+    //полные имена модулей от корня проекта и от корней пакетов -> file_id
+    mutable std::unordered_map<std::string, int> module_index;
+    mutable std::unordered_map<int, std::string> file_modules;
+    mutable std::unordered_set<int> package_files;
+    mutable bool module_index_loaded = false;
+
+    //кэш результатов: ключ запрос+параметры -> (write_version, значение)
+    //write_version хранится в таблице meta и растет при каждой записи, устаревшие записи не отдаются
+    //generation - случайное число, создается вместе с meta: отличает пересобранную или другую БД с тем же write_version
+    mutable std::mutex result_mtx;
+    std::unordered_map<std::string, std::pair<long long, std::any>> result_cache;
+    CacheStats cache_counters;
+    std::string cache_file;
+    //пишет поток записи (touch/commit), читают cache_lookup/cache_store из других потоков без блокировки
+    std::atomic<bool> version_dirty{false};
+
+    void load_class_hierarchy();
+    void load_module_index() const;
+    sqlite3_stmt* prepare_dangerous(const QueryFilter& filter);
+    void touch();
+    void bump_version();
+    bool savepoint(const char* name);
+    bool release(const char* name, bool keep);
+    bool cache_lookup(const std::string& key, std::any& value);
+    void cache_store(const std::string& key, std::any value);
+    long long meta_value(const char* key);
+    std::vector<Import> query_imports(const QueryFilter& filter);
+    std::shared_ptr<const DangerousGraph> dangerous_graph();
+    //экспорт в файл: попадание только если файл тот же, что записан (путь, размер, mtime)
+    bool export_cached(const std::string& key, const std::string& output);
+    void export_done(const std::string& key, const std::string& output);
+
+    template <typename T>
+    std::optional<T> cache_get(const std::string& key) {
+        std::any value;
+        if (!cache_lookup(key, value)) return std::nullopt;
+        return std::any_cast<T>(value);
+    }
+    template <typename T>
+    const T& cache_put(const std::string& key, const T& value) {
+        cache_store(key, value);
+        return value;
+    }
 
 public:
 
     DB(const std::string& path);
+    DB(const std::string& path, OpenMode mode);
     ~DB();
 
-    void add_file(const std::string& path);
-    void add_class(const std::string& name, int file_id, int start_line, int end_line);
-    void add_function(const std::string& name, int file_id, int class_id, int start_line, int end_line, const std::string& args);
-    void add_reference(int from_id, int to_id, const std::string& kind, const std::string& args = "");
+    DB(const DB&) = delete;
+    DB& operator=(const DB&) = delete;
 
-    std::vector<File> files();
-    void create_graph(const std::string& output_file="inheritance.dot");
-    void create_call_graph(const std::string& output_file="call_graph.dot");
+    const std::string& path() const { return db_path; }
+    OpenMode mode() const { return open_mode; }
+    //открыта транзакция begin() без commit(): другие соединения ее изменений не видят
+    bool in_transaction() const { return conn && !sqlite3_get_autocommit(conn); }
+
+    //add_*: false - строка не записана (ошибка prepare/step в cerr)
+    bool add_file(const std::string& path);
+    bool add_class(const std::string& name, int file_id, int start_line, int end_line, const std::string& bases = "");
+    bool add_function(const std::string& name, int file_id, int class_id, int start_line, int end_line, const std::string& args, const std::string& decorators = "");
+    //file_id - файл вызова, нужен для кода уровня модуля (from_id = 0)
+    bool add_reference(int from_id, int to_id, const std::string& kind, const std::string& args = "", int line = 0, int file_id = 0);
+
+    std::vector<File> files(const QueryFilter& filter = QueryFilter());
+    //экспорты в файл: false - файл не записан, причина в cerr
+    bool create_graph(const std::string& output_file="inheritance.dot");
+    bool create_call_graph(const std::string& output_file="call_graph.dot");
+    bool create_rollup_graph(const std::string& level, const std::string& output_file="rollup.dot");
     void ents(const std::string& filename, bool include_builtin);
-    std::vector<Import> get_all_imports(const std::string& save_file);
-    std::vector<DangerousCall> get_dangerous();
-    
+    //несколько файлов или glob (*.py, pkg/*/views.py) в один отчет
+    //glob - от корня проекта, если ничего не нашлось - с любого каталога; * не переходит через /, ** - переходит
+    //false - ни один файл не найден или отчет не записан
+    bool ents(const std::vector<std::string>& patterns, bool include_builtin, const std::string& output_file = "");
+    std::vector<Import> get_all_imports(const std::string& save_file = "", const QueryFilter& filter = QueryFilter());
+    //только файл верхних модулей, false - не удалось записать
+    bool save_imports(const std::string& save_file, const QueryFilter& filter = QueryFilter());
+    std::vector<DangerousCall> get_dangerous(const QueryFilter& filter = QueryFilter());
+
+    ColumnTable files_columns();
+    ColumnTable refs_columns();
+    ColumnTable imports_columns();
+    ColumnTable dangerous_columns(const QueryFilter& filter = QueryFilter());
+
+    std::unique_ptr<Cursor<Reference>> iter_refs(size_t chunk_size = 1024);
+    std::unique_ptr<Cursor<Import>> iter_imports(size_t chunk_size = 1024);
+    std::unique_ptr<Cursor<DangerousCall>> iter_dangerous(size_t chunk_size = 1024, const QueryFilter& filter = QueryFilter());
+    std::vector<DangerousPath> get_dangerous_paths(const std::vector<std::string>& entry_patterns);
+    std::vector<DeadSymbol> dead_code(const std::vector<std::string>& roots = {});
+
+    //бинарный снимок для mmap, формат в snapshot.h
+    bool export_snapshot(const std::string& path);
+
+    //symbols + fts5 trigram, строится после индексации
+    bool build_symbol_index();
+    std::vector<SymbolMatch> search(const std::string& query, const std::string& kind = "", int limit = 20);
+
 
     int last_insert_id();
+    void begin();
+    void commit();
+    void rollback();
+    bool clear();
+
+    long long write_version();
+    CacheStats cache_stats() const;
+    void clear_cache();
+    //кэш на диске рядом с БД (по умолчанию <db>.cache), грузится только при совпадении write_version и generation
+    bool load_cache(const std::string& path = "");
+    bool save_cache(const std::string& path = "");
+    //сохранять кэш в файл при закрытии
+    void persist_cache(const std::string& path = "");
 
     int get_class_id_by_name(const std::string& class_name);
-    void add_import(int file_id, const std::string& module, const std::string& name);
+    bool add_import(int file_id, const std::string& module, const std::string& name, int target_file_id = 0);
+    bool add_export(int file_id, const std::string& name);
     int get_function_id_by_name(const std::string& func_name);
     int get_function_id_by_name_class(const std::string& func_name, int class_id);
     
     bool is_project_module(const std::string& module) const;
+    int resolve_module(const std::string& module) const;
+    int resolve_import(int file_id, const std::string& module, const std::string& name, int level) const;
+
+    bool create_import_graph(const std::string& output_file="imports.dot");
+    std::vector<std::vector<std::string>> import_cycles();
+    std::vector<std::vector<std::string>> import_layers();
+
+    //false - иерархия не записана, прежние class_mro/class_tree остаются
+    bool build_class_hierarchy();
+    bool is_subclass(int class_id, int base_id);
+    int resolve_method(const std::string& func_name, int class_id, bool skip_self = false);
+    std::vector<std::string> mro(const std::string& class_name);
+    std::vector<std::string> subclasses(const std::string& class_name);
+};
+
+//пул соединений для параллельных отчетов, каждое соединение выдается одному потоку
+class DBPool : public std::enable_shared_from_this<DBPool> {
+private:
+    std::string path;
+    OpenMode mode;
+    size_t max_size;
+    size_t created = 0;
+    std::vector<std::unique_ptr<DB>> idle;
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    void release(DB* db);
+
+public:
+    DBPool(const std::string& path, size_t size, OpenMode mode = OpenMode::READ_ONLY);
+
+    //создавать через std::make_shared, handle возвращается в пул при уничтожении
+    std::shared_ptr<DB> acquire();
+    size_t size() const { return max_size; }
 };
@@ -0,0 +1,86 @@
+#include "hooks.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+bool glob_match(std::string_view pattern, std::string_view text) {
+    size_t p = 0, t = 0;
+    size_t star = std::string_view::npos, mark = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+            p++;
+            t++;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            mark = t;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            t = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') p++;
+    return p == pattern.size();
+}
+
+void HookMatcher::add(const std::string& pattern) {
+    size_t wild = pattern.find_first_of("*?");
+    std::string_view literal(pattern.data(), wild == std::string::npos ? pattern.size() : wild);
+
+    uint32_t node = 0;
+    for (char c : literal) {
+        auto& next = nodes[node].next;
+        auto it = std::find_if(next.begin(), next.end(), [c](const auto& e) { return e.first == c; });
+        if (it != next.end()) {
+            node = it->second;
+            continue;
+        }
+        uint32_t id = (uint32_t)nodes.size();
+        nodes[node].next.emplace_back(c, id);
+        nodes.emplace_back();
+        node = id;
+    }
+
+    if (wild == std::string::npos) nodes[node].exact = true;
+    else if (pattern.compare(wild, std::string::npos, "*") == 0) nodes[node].any_rest = true;
+    else nodes[node].globs.push_back(pattern.substr(wild));
+    patterns++;
+}
+
+bool HookMatcher::match(std::string_view name) const {
+    uint32_t node = 0;
+    for (size_t i = 0;; i++) {
+        const Node& n = nodes[node];
+        if (n.any_rest) return true;
+        for (const auto& g : n.globs) {
+            if (glob_match(g, name.substr(i))) return true;
+        }
+        if (i == name.size()) return n.exact;
+
+        auto it = std::find_if(n.next.begin(), n.next.end(), [&](const auto& e) { return e.first == name[i]; });
+        if (it == n.next.end()) return false;
+        node = it->second;
+    }
+}
+
+bool load_hook_file(const std::string& path, std::vector<std::string>& hooks) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "cant open hook file: " << path << "\n";
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::stringstream ss(line);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            size_t b = item.find_first_not_of(" \t\r");
+            size_t e = item.find_last_not_of(" \t\r");
+            if (b != std::string::npos) hooks.push_back(item.substr(b, e - b + 1));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+//набор шаблонов -hook, собранный в префиксное дерево по литеральному началу шаблона
+//в узле: точное совпадение, "дальше что угодно" (pkg.api.*) и хвосты с * и ? для проверки остатка
+//проверка имени - один проход по дереву, результат кешируется на code object, так что размер набора на события не влияет
+class HookMatcher {
+private:
+    struct Node {
+        std::vector<std::pair<char, uint32_t>> next;
+        bool exact = false;
+        bool any_rest = false;
+        std::vector<std::string> globs;
+    };
+    std::vector<Node> nodes{Node()};
+    size_t patterns = 0;
+
+public:
+    //* - любая подстрока (в том числе с точками), ? - один символ
+    void add(const std::string& pattern);
+    bool match(std::string_view name) const;
+    size_t size() const { return patterns; }
+    bool empty() const { return patterns == 0; }
+};
+
+bool glob_match(std::string_view pattern, std::string_view text);
+
+//шаблоны из файла: по одному или через запятую, # - комментарий
+bool load_hook_file(const std::string& path, std::vector<std::string>& hooks);
@@ -0,0 +1,1225 @@
+#include "indexer.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <sqlite3.h>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+
+std::string get_call_name(PyObject* func);
+std::string expr_to_str(PyObject* node);
+std::string extract_call_args(PyObject* call);
+
+static PyObject* g_ast_module = nullptr;
+static PyObject* g_current_source = nullptr;
+
+
+namespace fs = std::filesystem;
+
+
+bool create_project_db(const std::string& db_path) {
+    sqlite3* db;
+    if (sqlite3_open(db_path.c_str(), &db)) {
+        std::cerr << "Cannot create database: " << sqlite3_errmsg(db) << std::endl;
+        return false;
+    }
+
+    const char* sql = R"(
+    CREATE TABLE IF NOT EXISTS files(
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        path TEXT NOT NULL
+    );
+    CREATE TABLE IF NOT EXISTS classes(
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        name TEXT,
+        file_id INTEGER,
+        start_line INTEGER,
+        end_line INTEGER,
+        bases TEXT
+    );
+    CREATE TABLE IF NOT EXISTS class_mro(
+        class_id INTEGER,
+        pos INTEGER,
+        base_id INTEGER,
+        PRIMARY KEY(class_id, pos)
+    );
+    CREATE INDEX IF NOT EXISTS class_mro_base ON class_mro(base_id);
+    CREATE TABLE IF NOT EXISTS class_tree(
+        class_id INTEGER PRIMARY KEY,
+        pre INTEGER,
+        post INTEGER
+    );
+    CREATE TABLE IF NOT EXISTS functions(
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        name TEXT,
+        class_id INTEGER,
+        file_id INTEGER,
+        start_line INTEGER,
+        end_line INTEGER,
+        args TEXT,
+        decorators TEXT
+    );
+    CREATE TABLE IF NOT EXISTS refs(
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        from_id INTEGER,
+        to_id INTEGER,
+        kind TEXT,
+        args TEXT,
+        line INTEGER,
+        file_id INTEGER
+    );
+        CREATE TABLE IF NOT EXISTS imports(
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        file_id INTEGER,
+        module TEXT,
+        name TEXT,
+        target_file_id INTEGER
+    );
+    CREATE INDEX IF NOT EXISTS files_path ON files(path);
+    CREATE INDEX IF NOT EXISTS classes_name ON classes(name);
+    CREATE INDEX IF NOT EXISTS functions_name ON functions(name);
+    CREATE INDEX IF NOT EXISTS functions_file ON functions(file_id);
+    CREATE INDEX IF NOT EXISTS refs_kind ON refs(kind);
+    CREATE INDEX IF NOT EXISTS imports_file ON imports(file_id);
+    CREATE INDEX IF NOT EXISTS imports_module ON imports(module);
+    CREATE TABLE IF NOT EXISTS meta(
+        key TEXT PRIMARY KEY,
+        value INTEGER
+    );
+    INSERT OR IGNORE INTO meta(key, value) VALUES('write_version', 0);
+    CREATE TABLE IF NOT EXISTS exports(
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        file_id INTEGER,
+        name TEXT
+    );
+    )";
+
+    char* err_msg = nullptr;
+    if (sqlite3_exec(db, sql, 0, 0, &err_msg) != SQLITE_OK) {
+        std::cerr << "SQL error: " << err_msg << std::endl;
+        sqlite3_free(err_msg);
+        sqlite3_close(db);
+        return false;
+    }
+    if (!upgrade_schema(db)) {
+        std::cerr << "Cannot upgrade database schema: " << db_path << std::endl;
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_close(db);
+    return true;
+}
+
+std::string read_python_file(const std::string& path) {
+    std::ifstream infile(path, std::ios::binary);
+    if (!infile.is_open()) return "";
+
+    std::stringstream buffer;
+    buffer << infile.rdbuf();
+    std::string source = buffer.str();
+    // удаление bom
+    if (source.size() >= 3 &&
+        (unsigned char)source[0] == 0xEF &&
+        (unsigned char)source[1] == 0xBB &&
+        (unsigned char)source[2] == 0xBF) {
+        source = source.substr(3);
+    }
+
+    return source;
+}
+
+std::vector<std::string> read_sources(const std::vector<File>& files, int jobs) {
+    std::vector<std::string> sources(files.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) sources[i] = read_python_file(files[i].path);
+    };
+
+    std::vector<std::thread> threads;
+    for (int j = 1; j < jobs; j++) threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads) t.join();
+    return sources;
+}
+
+std::vector<std::string> scan_source_files(const std::string& project_path) {
+    std::vector<std::string> files;
+    for (auto& p : fs::recursive_directory_iterator(project_path)) {
+        if (p.is_regular_file()) {
+            std::string ext = p.path().extension().string();
+            if (ext == ".py") {
+                files.push_back(p.path().string());
+            }
+        }
+    }
+    return files;
+}
+
+PyObject* get_attr(PyObject* obj, const char* attr) {
+    PyObject* value = PyObject_GetAttrString(obj, attr);
+    if (!value) PyErr_Clear();
+    return value;
+}
+
+
+std::string safe_unparse(PyObject* node) {
+    //читаемое представление ast-узла (fallback)
+    if (!node) return "<expr>";
+
+    //если это Name (переменная) или Attribute (obj.method)
+    if (PyObject_HasAttrString(node, "id")) { // ast.Name(id=...)
+        PyObject* id = get_attr(node, "id");
+        if (id) {
+            const char* s = PyUnicode_AsUTF8(id);
+            return s ? std::string(s) : "<expr>";
+        }
+    }
+    if (PyObject_HasAttrString(node, "attr") && PyObject_HasAttrString(node, "value")) { // ast.Attribute
+        PyObject* value = get_attr(node, "value"); // Name(id='obj')
+        PyObject* attr = get_attr(node, "attr"); // method
+        std::string left = expr_to_str(value); // для случаев obj1.obj2...attr
+        const char* an = attr ? PyUnicode_AsUTF8(attr) : nullptr;
+        return left + "." + (an ? an : "<expr>");
+    }
+
+    //ast.get_source_segment(g_current_source, node)
+    if (g_ast_module && g_current_source) {
+        PyObject* get_src = PyObject_GetAttrString(g_ast_module, "get_source_segment"); // ast.get_source_segment извлекает конкретный фрагмент кода по узлу
+        if (get_src && PyCallable_Check(get_src)) {
+            PyObject* res = PyObject_CallFunctionObjArgs(get_src, g_current_source, node, nullptr);
+            Py_XDECREF(get_src);
+            if (res) {
+                if (res != Py_None) {
+                    const char* s = PyUnicode_AsUTF8(res);
+                    std::string out = s ? s : "<expr>";
+                    Py_DECREF(res);
+                    return out;
+                }
+                Py_DECREF(res);
+            }
+            PyErr_Clear();
+        } else {
+            Py_XDECREF(get_src);
+        }
+    }
+
+    
+    if (g_ast_module) {
+        // ast.unparse(node), генерит код из AST
+        PyObject* unparse = PyObject_GetAttrString(g_ast_module, "unparse");
+        if (unparse && PyCallable_Check(unparse)) {
+            PyObject* res = PyObject_CallFunctionObjArgs(unparse, node, nullptr);
+            Py_XDECREF(unparse);
+            if (res) {
+                const char* s = PyUnicode_AsUTF8(res);
+                std::string out = s ? s : "<expr>";
+                Py_DECREF(res);
+                if (out.find("<ast.") != std::string::npos) return "<expr>";
+                return out;
+            }
+            PyErr_Clear();
+        } else {
+            Py_XDECREF(unparse);
+        }
+
+        //ast.dump(node), дампит структуру ast
+        PyObject* dump = PyObject_GetAttrString(g_ast_module, "dump");
+        if (dump && PyCallable_Check(dump)) {
+            PyObject* res = PyObject_CallFunctionObjArgs(dump, node, nullptr);
+            Py_XDECREF(dump);
+            if (res) {
+                const char* s = PyUnicode_AsUTF8(res);
+                std::string out = s ? s : "<expr>";
+                Py_DECREF(res);
+                if (out.find("<ast.") != std::string::npos) return "<expr>";
+                return out;
+            }
+            PyErr_Clear();
+        } else {
+            Py_XDECREF(dump);
+        }
+    }
+
+    //repr(node)
+    PyObject* reprobj = PyObject_Repr(node);
+    if (reprobj) {
+        const char* r = PyUnicode_AsUTF8(reprobj);
+        std::string s = r ? r : "<expr>";
+        Py_DECREF(reprobj);
+        if (s.find("<ast.") != std::string::npos) return "<expr>";
+        return s;
+    }
+
+    return "<expr>";
+}
+
+std::string slice_to_str(PyObject* slice) {
+    if (!slice) return "<slice>";
+
+    if (PyObject_HasAttrString(slice, "value")) { // индекс [val]
+        PyObject* v = get_attr(slice, "value");
+        return expr_to_str(v);
+    }
+    if (PyObject_HasAttrString(slice, "lower") || PyObject_HasAttrString(slice, "upper")) { // [a:b:c]
+        PyObject* lower = get_attr(slice, "lower");
+        PyObject* upper = get_attr(slice, "upper");
+        PyObject* step = get_attr(slice, "step");
+        std::string out;
+        out += lower ? expr_to_str(lower) : "";
+        out += ":";
+        out += upper ? expr_to_str(upper) : "";
+        if (step) out += ":" + expr_to_str(step);
+        return out;
+    }
+    // fallback
+    return expr_to_str(slice);
+}
+
+std::string expr_to_str(PyObject* node) {
+    //ast узел в читаемый вид
+    if (!node) return "<expr>";
+
+    if (PyLong_Check(node)) return std::to_string(PyLong_AsLong(node));
+    if (PyFloat_Check(node)) return std::to_string(PyFloat_AsDouble(node));
+    if (PyUnicode_Check(node)) {
+        const char* s = PyUnicode_AsUTF8(node);
+        return s ? std::string("\"") + s + "\"" : "<expr>";
+    }
+    if (node == Py_True) return "True";
+    if (node == Py_False) return "False";
+    if (node == Py_None) return "None";
+
+    //ast.Constant
+    if (PyObject_HasAttrString(node, "value")) {
+        PyObject* value = get_attr(node, "value");
+        if (value) {
+            if (PyUnicode_Check(value)) {
+                const char* s = PyUnicode_AsUTF8(value);
+                return s ? std::string("\"") + s + "\"" : "<expr>";
+            }
+            if (PyLong_Check(value)) return std::to_string(PyLong_AsLong(value));
+            if (PyFloat_Check(value)) return std::to_string(PyFloat_AsDouble(value));
+            if (value == Py_True) return "True";
+            if (value == Py_False) return "False";
+            if (value == Py_None) return "None";
+            PyObject* reprobj = PyObject_Repr(value);
+            if (reprobj) {
+                const char* r = PyUnicode_AsUTF8(reprobj);
+                std::string s = r ? r : "<expr>";
+                Py_DECREF(reprobj);
+                return s;
+            }
+        }
+    }
+
+    //простые идентификаторы ast.Name(id=)
+    if (PyObject_HasAttrString(node, "id")) {
+        PyObject* id = get_attr(node, "id");
+        if (id) {
+            const char* tmp = PyUnicode_AsUTF8(id);
+            return tmp ? std::string(tmp) : "<expr>";
+        }
+    }
+
+    //коллекции
+    if (PyObject_HasAttrString(node, "elts")) {
+        PyObject* elts = get_attr(node, "elts");
+        if (elts && PyList_Check(elts)) {
+            //определение tuple/list
+            if (PyObject_HasAttrString(node, "__class__")) {
+                PyObject* cls = get_attr(node, "__class__"); // класс узла
+                if (cls) {
+                    PyObject* nm = get_attr(cls, "__name__"); // имя класса
+                    const char* nm_s = nm ? PyUnicode_AsUTF8(nm) : nullptr;
+                    if (nm_s && std::string(nm_s) == "Tuple") {
+                        // tuple
+                        std::string out = "(";
+                        for (Py_ssize_t i = 0; i < PyList_Size(elts); i++) {
+                            if (i) out += ", ";
+                            out += expr_to_str(PyList_GetItem(elts, i)); //для вложенных
+                        }
+                        out += ")";
+                        return out;
+                    }
+                }
+            }
+            // list
+            std::string out = "[";
+            for (Py_ssize_t i = 0; i < PyList_Size(elts); i++) {
+                if (i) out += ", ";
+                out += expr_to_str(PyList_GetItem(elts, i));
+            }
+            out += "]";
+            return out;
+        }
+    }
+
+    // словарь
+    if (PyObject_HasAttrString(node, "keys") && PyObject_HasAttrString(node, "values")) {
+        PyObject* keys = get_attr(node, "keys");
+        PyObject* values = get_attr(node, "values");
+        if (keys && values && PyList_Check(keys) && PyList_Check(values)) {
+            std::string out = "{";
+            Py_ssize_t n = PyList_Size(keys);
+            for (Py_ssize_t i = 0; i < n; i++) {
+                if (i) out += ", ";
+                out += expr_to_str(PyList_GetItem(keys, i)) + ": " + expr_to_str(PyList_GetItem(values, i));
+            }
+            out += "}";
+            return out;
+        }
+    }
+
+    //вызовы
+    if (PyObject_HasAttrString(node, "func")) {
+        PyObject* func = get_attr(node, "func");
+        if (func) {
+            std::string name = get_call_name(func);
+            std::string args = extract_call_args(node);
+            if (!name.empty()) return name + args;
+            // fallback рекурсивно обработка func + аргументы
+            return expr_to_str(func) + args;
+        }
+    }
+
+    //атрибуты объекта
+    if (PyObject_HasAttrString(node, "value") && PyObject_HasAttrString(node, "attr")) {
+        PyObject* value = get_attr(node, "value");
+        PyObject* attr = get_attr(node, "attr");
+        const char* an = attr ? PyUnicode_AsUTF8(attr) : nullptr;
+        return expr_to_str(value) + "." + (an ? an : "<expr>");
+    }
+
+    //срезы
+    if (PyObject_HasAttrString(node, "value") && PyObject_HasAttrString(node, "slice")) {
+        PyObject* value = get_attr(node, "value");
+        PyObject* slice = get_attr(node, "slice");
+        return expr_to_str(value) + "[" + slice_to_str(slice) + "]";
+    }
+
+    // логические операции
+    if (PyObject_HasAttrString(node, "values") && PyObject_HasAttrString(node, "op")) {
+        PyObject* vals = get_attr(node, "values"); // список операндов
+        PyObject* op = get_attr(node, "op"); // оператор
+        const char* opname = nullptr;
+        if (op && PyObject_HasAttrString(op, "__class__")) {
+            PyObject* cls = get_attr(op, "__class__");
+            PyObject* nm = cls ? get_attr(cls, "__name__") : nullptr; // имя оператора
+            opname = nm ? PyUnicode_AsUTF8(nm) : nullptr;
+        }
+        std::string op_s = opname ? (std::string(opname) == "And" ? "and" : (std::string(opname) == "Or" ? "or" : opname)) : "<op>";
+        if (vals && PyList_Check(vals)) {
+            std::string out;
+            for (Py_ssize_t i = 0; i < PyList_Size(vals); i++) {
+                if (i) out += " " + op_s + " ";
+                out += expr_to_str(PyList_GetItem(vals, i)); // рекурсивно обработка операндов
+            }
+            return "(" + out + ")";
+        }
+    }
+
+    // сравнения
+    if (PyObject_HasAttrString(node, "left") && PyObject_HasAttrString(node, "ops") && PyObject_HasAttrString(node, "comparators")) {
+        PyObject* left = get_attr(node, "left"); // левый операнд
+        PyObject* ops = get_attr(node, "ops"); //список операторорв сравнения
+        PyObject* comps = get_attr(node, "comparators"); // список правых операндов (один на каждый оператор)
+        if (ops && comps && PyList_Check(ops) && PyList_Check(comps)) {
+            std::string out = expr_to_str(left);
+            Py_ssize_t n = PyList_Size(ops);
+            for (Py_ssize_t i = 0; i < n; i++) {
+                PyObject* op = PyList_GetItem(ops, i);
+                PyObject* comp = PyList_GetItem(comps, i);
+                const char* opname = nullptr; // имя оператора (eq, lt..)
+                if (op && PyObject_HasAttrString(op, "__class__")) {
+                    PyObject* cls = get_attr(op, "__class__");
+                    PyObject* nm = cls ? get_attr(cls, "__name__") : nullptr;
+                    opname = nm ? PyUnicode_AsUTF8(nm) : nullptr;
+                }
+                std::string op_s = opname ? std::string(opname) : "<cmp>";
+                if (op_s == "Eq") op_s = "==";
+                else if (op_s == "NotEq") op_s = "!=";
+                else if (op_s == "Lt") op_s = "<";
+                else if (op_s == "LtE") op_s = "<=";
+                else if (op_s == "Gt") op_s = ">";
+                else if (op_s == "GtE") op_s = ">=";
+                out += " " + op_s + " " + expr_to_str(comp);
+            }
+            return "(" + out + ")";
+        }
+    }
+
+    // унарные операторы
+    if (PyObject_HasAttrString(node, "operand") && PyObject_HasAttrString(node, "op")) {
+        PyObject* op = get_attr(node, "op");
+        PyObject* operand = get_attr(node, "operand");
+        const char* opname = nullptr;
+        if (op && PyObject_HasAttrString(op, "__class__")) {
+            PyObject* cls = get_attr(op, "__class__");
+            PyObject* nm = cls ? get_attr(cls, "__name__") : nullptr;
+            opname = nm ? PyUnicode_AsUTF8(nm) : nullptr;
+        }
+        std::string op_s = opname ? std::string(opname) : "<uop>";
+        if (op_s == "Not") op_s = "not ";
+        else if (op_s == "USub") op_s = "-";
+        else if (op_s == "UAdd") op_s = "+";
+        return op_s + expr_to_str(operand);
+    }
+
+    // тернарные выражения x if cond else...
+    if (PyObject_HasAttrString(node, "test") && PyObject_HasAttrString(node, "body") && PyObject_HasAttrString(node, "orelse")) {
+        PyObject* test = get_attr(node, "test"); // условие
+        PyObject* body = get_attr(node, "body"); // тело (true)
+        PyObject* orelse = get_attr(node, "orelse"); // false
+        return "(" + expr_to_str(body) + " if " + expr_to_str(test) + " else " + expr_to_str(orelse) + ")";
+    }
+
+    // lambda/gen-exps
+    if (PyObject_HasAttrString(node, "args") && PyObject_HasAttrString(node, "body")) return "<lambda>";
+    if (PyObject_HasAttrString(node, "generators")) return "<comprehension>";
+
+    // fallback
+    return safe_unparse(node);
+}
+
+
+
+
+std::string extract_function_args(PyObject* func_node) {
+    PyObject* args = get_attr(func_node, "args");
+    if (!args) return "";
+
+    std::vector<std::string> result;
+
+    PyObject* py_args = get_attr(args, "args");
+    if (py_args && PyList_Check(py_args)) {
+        Py_ssize_t total = PyList_Size(py_args);
+
+        PyObject* defaults = get_attr(args, "defaults");
+        Py_ssize_t defaults_count = defaults ? PyList_Size(defaults) : 0;
+        Py_ssize_t no_default = total - defaults_count;
+
+        for (Py_ssize_t i = 0; i < total; i++) {
+            PyObject* arg = PyList_GetItem(py_args, i);
+            PyObject* name = get_attr(arg, "arg");
+            if (!name) continue;
+
+            std::string arg_name = PyUnicode_AsUTF8(name);
+
+            if (i >= no_default) {
+                arg_name += "=...";
+            }
+
+            result.push_back(arg_name);
+        }
+    }
+    //*args
+    PyObject* vararg = get_attr(args, "vararg");
+    if (vararg) {
+        PyObject* name = get_attr(vararg, "arg");
+        if (name)
+            result.push_back("*" + std::string(PyUnicode_AsUTF8(name)));
+    }
+    // **kwargs
+    PyObject* kwarg = get_attr(args, "kwarg");
+    if (kwarg) {
+        PyObject* name = get_attr(kwarg, "arg");
+        if (name)
+            result.push_back("**" + std::string(PyUnicode_AsUTF8(name)));
+    }
+
+    std::string out = "(";
+    for (size_t i = 0; i < result.size(); i++) {
+        out += result[i];
+        if (i + 1 < result.size())
+            out += ", ";
+    }
+    out += ")";
+    return out;
+}
+
+std::string extract_decorators(PyObject* func_node) {
+    //имена декораторов через запятую, @app.route("/") -> app.route
+    PyObject* decorators = get_attr(func_node, "decorator_list");
+    if (!decorators || !PyList_Check(decorators)) {
+        Py_XDECREF(decorators);
+        return "";
+    }
+
+    std::string out;
+    for (Py_ssize_t i = 0; i < PyList_Size(decorators); i++) {
+        PyObject* dec = PyList_GetItem(decorators, i);
+        PyObject* func = PyObject_HasAttrString(dec, "func") ? get_attr(dec, "func") : nullptr;
+        std::string name = expr_to_str(func ? func : dec);
+        Py_XDECREF(func);
+        if (!out.empty()) out += ",";
+        out += name;
+    }
+    Py_DECREF(decorators);
+    return out;
+}
+
+std::string extract_call_args(PyObject* call) {
+    if (!call) return "";
+
+    std::vector<std::string> args;
+
+    PyObject* py_args = get_attr(call, "args");
+    if (py_args && PyList_Check(py_args)) {
+        for (Py_ssize_t i = 0; i < PyList_Size(py_args); i++) {
+            PyObject* item = PyList_GetItem(py_args, i);
+            args.push_back(expr_to_str(item));
+        }
+    }
+
+    PyObject* kwargs = get_attr(call, "keywords");
+    if (kwargs && PyList_Check(kwargs)) {
+        for (Py_ssize_t i = 0; i < PyList_Size(kwargs); i++) {
+            PyObject* kw = PyList_GetItem(kwargs, i);
+            PyObject* arg = get_attr(kw, "arg");
+            PyObject* val = get_attr(kw, "value");
+            if (arg && val) {
+                const char* cname = PyUnicode_AsUTF8(arg);
+                if (cname)
+                    args.push_back(std::string(cname) + "=" + expr_to_str(val));
+            }
+        }
+    }
+
+    std::string res = "(";
+    for (size_t i = 0; i < args.size(); i++) {
+        res += args[i];
+        if (i + 1 < args.size()) res += ", ";
+    }
+    res += ")";
+    return res;
+}
+
+
+std::string get_call_name(PyObject* func) {
+    if (!func) return "";
+
+    // obj.method()
+    if (PyObject_HasAttrString(func, "attr") && PyObject_HasAttrString(func, "value")) {
+        PyObject* attr = get_attr(func, "attr");
+        PyObject* value = get_attr(func, "value");
+        if (attr && value && PyObject_HasAttrString(value, "id")) {
+            PyObject* id = get_attr(value, "id");
+            if (id) {
+                const char* cid = PyUnicode_AsUTF8(id);
+                const char* cname = PyUnicode_AsUTF8(attr);
+                if (cid && cname) return cname;
+            }
+        }
+    }
+
+    //func()
+    if (PyObject_HasAttrString(func, "id")) {
+        PyObject* id = get_attr(func, "id");
+        if (id) {
+            const char* cname = PyUnicode_AsUTF8(id);
+            if (cname) return cname;
+        }
+    }
+
+    return "";
+}
+
+PyObject* extract_call(PyObject* node, PyObject* CallType, PyObject* AwaitType) {
+    if (!node) return nullptr;
+    if (PyObject_IsInstance(node, CallType)) return node;
+
+    if (PyObject_IsInstance(node, AwaitType)) {
+        PyObject* value = get_attr(node, "value");
+        if (value && PyObject_IsInstance(value, CallType))
+            return value;
+    }
+
+    return nullptr;
+}
+
+
+int resolve_node_type(PyObject* node, PyObject* ast_module, const std::vector<int>& class_stack, const std::vector<std::unordered_map<std::string, int>>& var_type_stack, std::unordered_map<int, std::unordered_map<std::string, int>>& class_attr_types) {
+    if (!node || node == Py_None) return 0;
+
+    //простые имена (self, x..)
+    if (PyObject_HasAttrString(node, "id")) {
+        PyObject* py_id = PyObject_GetAttrString(node, "id");
+        if (py_id) {
+            const char* name_c = PyUnicode_AsUTF8(py_id);
+            std::string name = name_c ? name_c : "";
+            Py_DECREF(py_id);
+
+            if (name == "self" && !class_stack.empty()) return class_stack.back(); //если self то id текущего класса
+            if (!var_type_stack.empty()) {
+                auto it = var_type_stack.back().find(name);
+                if (it != var_type_stack.back().end()) return it->second;
+            }
+        }
+    }
+
+    // атрибуты рекурсивно (self.x, obj1.obj2..attr)
+    if (PyObject_HasAttrString(node, "attr") && PyObject_HasAttrString(node, "value")) {
+        PyObject* value_node = PyObject_GetAttrString(node, "value");
+        PyObject* attr_node = PyObject_GetAttrString(node, "attr");
+
+        std::string attr_name;
+        if (attr_node) {
+            const char* a = PyUnicode_AsUTF8(attr_node);
+            attr_name = a ? a : "";
+        }
+
+        int parent_type = resolve_node_type(value_node, ast_module, class_stack, var_type_stack, class_attr_types);
+
+        Py_XDECREF(value_node);
+        Py_XDECREF(attr_node);
+
+        if (parent_type != 0) {
+            auto cit = class_attr_types.find(parent_type);
+            if (cit != class_attr_types.end()) {
+                auto ait = cit->second.find(attr_name);
+                if (ait != cit->second.end()) return ait->second;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+bool parse_project(DB& db, const std::vector<File>& files, const std::vector<std::string>& sources, Pass pass, const ProgressFn& progress) {
+    PyObject* ast = PyImport_ImportModule("ast");
+    if (!ast) { PyErr_Print(); return false; }
+    
+    // Типы узлов
+    PyObject* ClassDefType = PyObject_GetAttrString(ast, "ClassDef");
+    PyObject* FunctionDefType = PyObject_GetAttrString(ast, "FunctionDef");
+    PyObject* AsyncFunctionDefType = PyObject_GetAttrString(ast, "AsyncFunctionDef");
+    PyObject* CallType = PyObject_GetAttrString(ast, "Call");
+    PyObject* AwaitType = PyObject_GetAttrString(ast, "Await");
+    PyObject* AssignType = PyObject_GetAttrString(ast, "Assign");
+    PyObject* AnnAssignType = PyObject_GetAttrString(ast, "AnnAssign");
+    PyObject* IfExpType = PyObject_GetAttrString(ast, "IfExp");
+    PyObject* iter_children = PyObject_GetAttrString(ast, "iter_child_nodes");
+    PyObject* builtins_mod = PyImport_ImportModule("builtins");
+    PyObject* ImportType = PyObject_GetAttrString(ast, "Import");
+    PyObject* ImportFromType = PyObject_GetAttrString(ast, "ImportFrom");
+
+    std::vector<std::unordered_map<std::string, int>> var_type_stack; //типы локальных переменных по областям видимости
+    std::unordered_map<int, std::unordered_map<std::string, int>> class_attr_types; // class_id: {attr_name: type_id}, типы атрибутов классов
+
+    const char* stage = pass == Pass::DECLARATIONS ? "declarations" : "references";
+    bool ok = true;     //первая неудачная запись останавливает проход
+    for (size_t fi = 0; ok && fi < files.size(); fi++) {
+        const File& f = files[fi];
+        if (progress) progress({stage, fi, files.size(), f.path});
+        const std::string& source = sources[fi];
+        if (source.empty()) continue;
+
+        PyObject* tree = PyObject_CallMethod(ast, "parse", "s", source.c_str());
+        if (!tree) { PyErr_Clear(); continue; }
+
+        std::vector<int> class_stack;
+        std::vector<int> function_stack;
+
+        std::function<void(PyObject*)> walk = [&](PyObject* node) {
+            if (!ok || !node || node == Py_None) return;
+
+            //pass1
+            if (pass == Pass::DECLARATIONS) {
+                if (PyObject_IsInstance(node, ClassDefType)) {
+                    PyObject* name = PyObject_GetAttrString(node, "name");
+                    if (name) {
+                        PyObject* lineno_obj = PyObject_GetAttrString(node, "lineno");
+                        PyObject* end_lineno_obj = PyObject_GetAttrString(node, "end_lineno");
+
+                        int start_line = lineno_obj ? (int)PyLong_AsLong(lineno_obj) : 0;
+                        int end_line = end_lineno_obj ? (int)PyLong_AsLong(end_lineno_obj) : start_line;
+
+                        //базовые классы по имени, разрешаются в build_class_hierarchy
+                        std::string bases_str;
+                        PyObject* bases = PyObject_GetAttrString(node, "bases");
+                        if (bases && PyList_Check(bases)) {
+                            for (Py_ssize_t i = 0; i < PyList_Size(bases); i++) {
+                                if (!bases_str.empty()) bases_str += ",";
+                                bases_str += expr_to_str(PyList_GetItem(bases, i));
+                            }
+                        }
+                        Py_XDECREF(bases);
+
+                        ok = db.add_class(PyUnicode_AsUTF8(name), f.id, start_line, end_line, bases_str) && ok;
+
+                        class_stack.push_back(db.last_insert_id());
+                        Py_DECREF(name);
+                    }
+                }
+                if (PyObject_IsInstance(node, FunctionDefType) || PyObject_IsInstance(node, AsyncFunctionDefType)) {
+                    PyObject* name = PyObject_GetAttrString(node, "name");
+                    if (name) {
+                        int class_id = class_stack.empty() ? 0 : class_stack.back();
+                        PyObject* lineno_obj = PyObject_GetAttrString(node, "lineno");
+                        PyObject* end_lineno_obj = PyObject_GetAttrString(node, "end_lineno");
+
+                        int start_line = lineno_obj ? (int)PyLong_AsLong(lineno_obj) : 0;
+                        int end_line = end_lineno_obj ? (int)PyLong_AsLong(end_lineno_obj) : start_line;
+
+                        Py_XDECREF(lineno_obj);
+                        Py_XDECREF(end_lineno_obj);
+
+                        ok = db.add_function(PyUnicode_AsUTF8(name), f.id, class_id, start_line, end_line, "", extract_decorators(node)) && ok;
+                        function_stack.push_back(db.last_insert_id());
+                        Py_DECREF(name);
+                    }
+                }
+
+                //__all__ = [...] на уровне модуля
+                if (class_stack.empty() && function_stack.empty() && PyObject_IsInstance(node, AssignType)) {
+                    PyObject* targets = PyObject_GetAttrString(node, "targets");
+                    PyObject* value = PyObject_GetAttrString(node, "value");
+                    bool is_all = false;
+                    if (targets && PyList_Check(targets) && PyList_Size(targets) == 1) {
+                        PyObject* id = get_attr(PyList_GetItem(targets, 0), "id");
+                        if (id) {
+                            const char* s = PyUnicode_AsUTF8(id);
+                            is_all = s && std::string(s) == "__all__";
+                            Py_DECREF(id);
+                        }
+                    }
+                    PyObject* elts = (is_all && value) ? get_attr(value, "elts") : nullptr;
+                    if (elts && PyList_Check(elts)) {
+                        for (Py_ssize_t i = 0; i < PyList_Size(elts); i++) {
+                            PyObject* cv = get_attr(PyList_GetItem(elts, i), "value");
+                            if (cv && PyUnicode_Check(cv)) ok = db.add_export(f.id, PyUnicode_AsUTF8(cv)) && ok;
+                            Py_XDECREF(cv);
+                        }
+                    }
+                    Py_XDECREF(elts);
+                    Py_XDECREF(targets);
+                    Py_XDECREF(value);
+                }
+            }
+
+            //pass2
+            if (pass == Pass::REFERENCES) {
+                if (PyObject_IsInstance(node, ClassDefType)) {
+                    PyObject* name_obj = PyObject_GetAttrString(node, "name");
+                    std::string class_name;
+                    if (name_obj) {
+                        const char* cn = PyUnicode_AsUTF8(name_obj);
+                        class_name = cn ? cn : "";
+                        Py_DECREF(name_obj);
+                    }
+                    int child_class_id = db.get_class_id_by_name(class_name);
+                    class_stack.push_back(child_class_id);
+                }
+                if (PyObject_IsInstance(node, FunctionDefType) || PyObject_IsInstance(node, AsyncFunctionDefType)) {
+                    PyObject* name = PyObject_GetAttrString(node, "name");
+                    if (name) {
+                        int class_id = class_stack.empty() ? 0 : class_stack.back();
+                        function_stack.push_back(db.get_function_id_by_name_class(PyUnicode_AsUTF8(name), class_id));
+                        var_type_stack.emplace_back();
+                        Py_DECREF(name);
+                    } else {
+                        function_stack.push_back(0);
+                        var_type_stack.emplace_back();
+                    }
+                }
+
+                //обработка присваиваний и аннотаций
+                bool is_assign = PyObject_IsInstance(node, AssignType);
+                bool is_ann_assign = PyObject_IsInstance(node, AnnAssignType);
+                
+                if (is_assign || is_ann_assign) {
+                    PyObject* value = PyObject_GetAttrString(node, "value");
+                    int inferred_type = 0;
+
+                    //если справа присваивания вызов (ctor)
+                    if (value && PyObject_IsInstance(value, CallType)) {
+                        PyObject* func = PyObject_GetAttrString(value, "func"); //что вызвалось
+                        if (func) {
+                            if (PyObject_HasAttrString(func, "id")) {
+                                PyObject* id = PyObject_GetAttrString(func, "id");
+                                if (id) {
+                                    const char* cname = PyUnicode_AsUTF8(id);
+                                    if (cname) inferred_type = db.get_class_id_by_name(cname);
+                                    Py_DECREF(id);
+                                }
+                            }
+                            //func.attr
+                            if (inferred_type == 0 && PyObject_HasAttrString(func, "attr")) {
+                                PyObject* attr = PyObject_GetAttrString(func, "attr");
+                                if (attr) {
+                                    const char* aname = PyUnicode_AsUTF8(attr);
+                                    if (aname) inferred_type = db.get_class_id_by_name(aname);
+                                    Py_DECREF(attr);
+                                }
+                            }
+                            Py_DECREF(func);
+                        }
+                    }
+
+                    // value - ifExp
+                    if (value && inferred_type == 0 && PyObject_HasAttrString(value, "body") && PyObject_HasAttrString(value, "orelse")) {
+                        PyObject* body = PyObject_GetAttrString(value, "body");
+                        PyObject* orelse = PyObject_GetAttrString(value, "orelse");
+
+                        //в body - calltype
+                        if (body && PyObject_IsInstance(body, CallType)) {
+                            PyObject* func = PyObject_GetAttrString(body, "func");
+                            if (func) {
+                                if (PyObject_HasAttrString(func, "id")) {
+                                    PyObject* id = PyObject_GetAttrString(func, "id");
+                                    if (id) { const char* s = PyUnicode_AsUTF8(id); if (s) inferred_type = db.get_class_id_by_name(s); Py_DECREF(id); }
+                                }
+                                if (inferred_type == 0 && PyObject_HasAttrString(func, "attr")) {
+                                    PyObject* attr = PyObject_GetAttrString(func, "attr");
+                                    if (attr) { const char* s = PyUnicode_AsUTF8(attr); if (s) inferred_type = db.get_class_id_by_name(s); Py_DECREF(attr); }
+                                }
+                                Py_DECREF(func);
+                            }
+                        }
+
+                        //в orelse - calltype
+                        if (inferred_type == 0 && orelse && PyObject_IsInstance(orelse, CallType)) {
+                            PyObject* func = PyObject_GetAttrString(orelse, "func");
+                            if (func) {
+                                if (PyObject_HasAttrString(func, "id")) {
+                                    PyObject* id = PyObject_GetAttrString(func, "id");
+                                    if (id) { const char* s = PyUnicode_AsUTF8(id); if (s) inferred_type = db.get_class_id_by_name(s); Py_DECREF(id); }
+                                }
+                                if (inferred_type == 0 && PyObject_HasAttrString(func, "attr")) {
+                                    PyObject* attr = PyObject_GetAttrString(func, "attr");
+                                    if (attr) { const char* s = PyUnicode_AsUTF8(attr); if (s) inferred_type = db.get_class_id_by_name(s); Py_DECREF(attr); }
+                                }
+                                Py_DECREF(func);
+                            }
+                        }
+
+                        Py_XDECREF(body);
+                        Py_XDECREF(orelse);
+                    }
+
+                    //если аннотированное присваивание, r: Re = Re()
+                    if (is_ann_assign && inferred_type == 0) {
+                        PyObject* ann = PyObject_GetAttrString(node, "annotation");
+                        if (ann) {
+                            if (PyObject_HasAttrString(ann, "id")) {
+                                PyObject* id = PyObject_GetAttrString(ann, "id");
+                                if (id) { const char* s = PyUnicode_AsUTF8(id); if (s) inferred_type = db.get_class_id_by_name(s); Py_DECREF(id); }
+                            }
+                            Py_XDECREF(ann);
+                        }
+                    }
+
+                    //сохраняем тип в контексте
+                    if (inferred_type) {
+                        PyObject* targets = is_assign ? PyObject_GetAttrString(node, "targets") : nullptr; //левое значение присв.
+                        PyObject* target = nullptr;
+                        if (is_assign && targets && PyList_Check(targets) && PyList_Size(targets) > 0) {
+                            target = PyList_GetItem(targets, 0); //правое значение
+                        } else if (is_ann_assign) {
+                            target = PyObject_GetAttrString(node, "target");
+                        }
+
+                        if (target) {
+                            //простое имя (Constr())
+                            if (PyObject_HasAttrString(target, "id")) {
+                                PyObject* id_obj = PyObject_GetAttrString(target, "id");
+                                if (id_obj) {
+                                    const char* vname = PyUnicode_AsUTF8(id_obj);
+                                    if (vname && !var_type_stack.empty()) var_type_stack.back()[vname] = inferred_type; //запоминаем тип переменной в контексте функции
+                                    Py_DECREF(id_obj);
+                                }
+                            }
+                            // self.attr = ..
+                            else if (PyObject_HasAttrString(target, "attr")) {
+                                PyObject* val_node = PyObject_GetAttrString(target, "value");
+                                if (val_node) {
+                                    if (PyObject_HasAttrString(val_node, "id")) {
+                                        PyObject* id_obj = PyObject_GetAttrString(val_node, "id");
+                                        if (id_obj) {
+                                            const char* vname = PyUnicode_AsUTF8(id_obj);
+                                            if (vname && std::string(vname) == "self" && !class_stack.empty()) { //атрибут класса
+                                                //ex: class S: self.repo = Repo()
+                                                //ex: class_attr_types[S_id]["repo"] = Repo_id
+                                                PyObject* aname_obj = PyObject_GetAttrString(target, "attr");
+                                                if (aname_obj) {
+                                                    const char* aname = PyUnicode_AsUTF8(aname_obj);
+                                                    if (aname) class_attr_types[class_stack.back()][aname] = inferred_type;
+                                                    Py_DECREF(aname_obj);
+                                                }
+                                            }
+                                            Py_DECREF(id_obj);
+                                        }
+                                    }
+                                    Py_DECREF(val_node);
+                                }
+                            }
+
+                            if (is_ann_assign && target) {
+                                if (!is_assign && target) Py_XDECREF(target);
+                            }
+                        }
+                        if (targets) Py_DECREF(targets);
+                    }
+
+                    Py_XDECREF(value);
+                }
+
+                //вызовы
+                PyObject* call = extract_call(node, CallType, AwaitType);
+                if (call) {
+                    int from_id = function_stack.empty() ? 0 : function_stack.back();
+                    PyObject* func = PyObject_GetAttrString(call, "func");
+                    std::string argsc = extract_call_args(call);
+                    PyObject* call_lineno = PyObject_GetAttrString(call, "lineno");
+                    int call_line = call_lineno ? (int)PyLong_AsLong(call_lineno) : 0;
+                    Py_XDECREF(call_lineno);
+
+                    if (func) {
+                        if (PyObject_HasAttrString(func, "attr")) { //obj.method()
+                            PyObject* target_node = PyObject_GetAttrString(func, "value");
+                            PyObject* attr_node = PyObject_GetAttrString(func, "attr");
+                            std::string method_name;
+                            if (attr_node) {
+                                const char* mn = PyUnicode_AsUTF8(attr_node);
+                                method_name = mn ? mn : "";
+                            }
+                            //определение класса объекта
+                            //ex:self.repo.method() -> ret Repo_id
+                            int target_class_id = resolve_node_type(target_node, ast, class_stack, var_type_stack, class_attr_types);
+                            bool via_super = false;
+                            //super().method() -> поиск по mro после текущего класса
+                            if (!target_class_id && !class_stack.empty() && target_node && PyObject_IsInstance(target_node, CallType)) {
+                                PyObject* super_func = get_attr(target_node, "func");
+                                PyObject* super_id = super_func ? get_attr(super_func, "id") : nullptr;
+                                const char* sn = super_id ? PyUnicode_AsUTF8(super_id) : nullptr;
+                                if (sn && std::string(sn) == "super") {
+                                    target_class_id = class_stack.back();
+                                    via_super = true;
+                                }
+                                Py_XDECREF(super_id);
+                                Py_XDECREF(super_func);
+                            }
+                            if (target_class_id) {
+                                int to_id = db.resolve_method(method_name, target_class_id, via_super);
+                                if (to_id) ok = db.add_reference(from_id, to_id, "call", argsc, call_line, f.id) && ok;
+                            }
+                            Py_XDECREF(target_node);
+                            Py_XDECREF(attr_node);
+                        } else if (PyObject_HasAttrString(func, "id")) { //func()
+                            PyObject* id_obj = PyObject_GetAttrString(func, "id");
+                            if (id_obj) {
+                                const char* name = PyUnicode_AsUTF8(id_obj);
+                                if (name) {
+                                    int to_id = db.get_function_id_by_name(name);
+                                    if (to_id) {
+                                        ok = db.add_reference(from_id, to_id, "call", argsc, call_line, f.id) && ok;
+                                    } else {
+                                        int cid = db.get_class_id_by_name(name);
+                                        if (cid) {
+                                            ok = db.add_reference(from_id, cid, "instantiate", argsc, call_line, f.id) && ok;
+                                        } else {
+                                            // проверка в __builtins__
+                                            if (builtins_mod && PyObject_HasAttrString(builtins_mod, name)) {
+                                                ok = db.add_reference(from_id, 0, "call_builtin:" + std::string(name), argsc, call_line, f.id) && ok;
+                                            }
+                                        }
+                                    }
+
+                                }
+                                Py_DECREF(id_obj);
+                            }
+                        }
+                        Py_DECREF(func);
+                    }
+                }
+
+                if (PyObject_IsInstance(node, ImportType)) {
+                    PyObject* names = PyObject_GetAttrString(node, "names");
+                    if (names && PyList_Check(names)) {
+                        Py_ssize_t n = PyList_Size(names);
+                        for (Py_ssize_t i = 0; i < n; i++) {
+                            PyObject* alias = PyList_GetItem(names, i);
+                            if (alias) {
+                                PyObject* name_obj = PyObject_GetAttrString(alias, "name");
+                                if (name_obj) {
+                                    const char* module_c = PyUnicode_AsUTF8(name_obj);
+                                    std::string module = module_c ? module_c : "";
+                                    
+                                    PyObject* asname_obj = PyObject_GetAttrString(alias, "asname");
+                                    std::string imported_name = module;
+                                    if (asname_obj && asname_obj != Py_None) {
+                                        const char* asname_c = PyUnicode_AsUTF8(asname_obj);
+                                        if (asname_c) imported_name = asname_c;
+                                    }
+                                    
+                                    if (!module.empty()) {
+                                        ok = db.add_import(f.id, module, imported_name, db.resolve_import(f.id, module, "", 0)) && ok;
+                                    }
+                                    
+                                    Py_XDECREF(name_obj);
+                                    Py_XDECREF(asname_obj);
+                                }
+                            }
+                        }
+                    }
+                    Py_XDECREF(names);
+                }
+                
+                //from module import name
+                else if (PyObject_IsInstance(node, ImportFromType)) {
+                    PyObject* module_obj = PyObject_GetAttrString(node, "module");
+                    std::string module = "";
+                    if (module_obj && module_obj != Py_None) {
+                        const char* module_c = PyUnicode_AsUTF8(module_obj);
+                        module = module_c ? module_c : "";
+                    }
+                    Py_XDECREF(module_obj);
+
+                    //from . import x, from ..pkg import y
+                    PyObject* level_obj = PyObject_GetAttrString(node, "level");
+                    int level = (level_obj && level_obj != Py_None) ? (int)PyLong_AsLong(level_obj) : 0;
+                    Py_XDECREF(level_obj);
+                    
+                    PyObject* names = PyObject_GetAttrString(node, "names");
+                    if (names && PyList_Check(names)) {
+                        Py_ssize_t n = PyList_Size(names);
+                        for (Py_ssize_t i = 0; i < n; i++) {
+                            PyObject* alias = PyList_GetItem(names, i);
+                            if (alias) {
+                                PyObject* name_obj = PyObject_GetAttrString(alias, "name");
+                                if (name_obj) {
+                                    const char* name_c = PyUnicode_AsUTF8(name_obj);
+                                    std::string name = name_c ? name_c : "";
+                                    
+                                    PyObject* asname_obj = PyObject_GetAttrString(alias, "asname");
+                                    std::string imported_name = name;
+                                    if (asname_obj && asname_obj != Py_None) {
+                                        const char* asname_c = PyUnicode_AsUTF8(asname_obj);
+                                        if (asname_c) imported_name = asname_c;
+                                    }
+                                    
+                                    if (!name.empty()) {
+                                        ok = db.add_import(f.id, module, imported_name, db.resolve_import(f.id, module, name, level)) && ok;
+                                    }
+                                    
+                                    Py_XDECREF(name_obj);
+                                    Py_XDECREF(asname_obj);
+                                }
+                            }
+                        }
+                    }
+                    Py_XDECREF(names);
+                }
+
+            }
+
+            //dfs
+            PyObject* children = PyObject_CallFunctionObjArgs(iter_children, node, nullptr);
+            if (children) {
+                PyObject* it = PyObject_GetIter(children);
+                PyObject* ch;
+                while ((ch = PyIter_Next(it))) {
+                    walk(ch);
+                    Py_DECREF(ch);
+                }
+                Py_DECREF(it);
+                Py_DECREF(children);
+            }
+
+            //pop ctx
+            if (PyObject_IsInstance(node, ClassDefType) && !class_stack.empty()) class_stack.pop_back();
+            if ((PyObject_IsInstance(node, FunctionDefType) || PyObject_IsInstance(node, AsyncFunctionDefType)) && !function_stack.empty()) {
+                function_stack.pop_back();
+                if (pass == Pass::REFERENCES) var_type_stack.pop_back();
+            }
+        };
+
+        walk(tree);
+        Py_DECREF(tree);
+    }
+
+    Py_XDECREF(ClassDefType); Py_XDECREF(FunctionDefType); Py_XDECREF(AsyncFunctionDefType);
+    Py_XDECREF(CallType); Py_XDECREF(AwaitType); Py_XDECREF(AssignType); Py_XDECREF(AnnAssignType);
+    Py_XDECREF(IfExpType); Py_XDECREF(iter_children); Py_XDECREF(builtins_mod); Py_XDECREF(ast);
+    if (ok && progress) progress({stage, files.size(), files.size(), ""});
+    return ok;
+}
+
+
+bool index_project(const std::string& project_path, const std::string& db_path, int jobs, const ProgressFn& progress) {
+    if (!fs::is_directory(project_path)) {
+        std::cerr << "not a directory: " << project_path << "\n";
+        return false;
+    }
+    if (!create_project_db(db_path)) return false;
+    if (jobs < 1) jobs = 1;
+
+    //свой интерпретатор только для pysec, в analyzer работаем в хост-процессе
+    bool own_interpreter = !Py_IsInitialized();
+    PyThreadState* main_state = nullptr;
+    if (own_interpreter) {
+        Py_Initialize();
+        main_state = PyEval_SaveThread();
+    }
+
+    //вся переиндексация - одна транзакция: при ошибке записи в БД остается прежний индекс
+    DB db(db_path);
+    db.begin();
+    bool ok = db.clear();
+
+    if (progress) progress({"scan", 0, 0, project_path});
+    std::vector<std::string> paths = ok ? scan_source_files(project_path) : std::vector<std::string>();
+
+    for (size_t i = 0; ok && i < paths.size(); i++) {
+        ok = db.add_file(paths[i]);
+        if (progress) progress({"files", i + 1, paths.size(), paths[i]});
+    }
+    std::vector<File> files = ok ? db.files() : std::vector<File>();
+
+    if (progress) progress({"read", 0, files.size(), ""});
+    std::vector<std::string> sources = read_sources(files, jobs);
+
+    //ast обходится под GIL
+    if (ok) {
+        PyGILState_STATE gil = PyGILState_Ensure();
+        ok = parse_project(db, files, sources, Pass::DECLARATIONS, progress);
+        PyGILState_Release(gil);
+    }
+
+    if (ok) {
+        if (progress) progress({"hierarchy", 0, 0, ""});
+        ok = db.build_class_hierarchy();
+    }
+
+    if (ok) {
+        PyGILState_STATE gil = PyGILState_Ensure();
+        ok = parse_project(db, files, sources, Pass::REFERENCES, progress);
+        PyGILState_Release(gil);
+    }
+
+    if (ok) {
+        if (progress) progress({"symbols", 0, 0, ""});
+        ok = db.build_symbol_index();
+    }
+
+    if (ok) {
+        db.commit();
+        ok = !db.in_transaction();
+    }
+    if (!ok) {
+        db.rollback();
+        std::cerr << "indexing failed, database left unchanged: " << db_path << "\n";
+    }
+
+    if (own_interpreter) {
+        PyEval_RestoreThread(main_state);
+        Py_Finalize();
+    }
+
+    if (ok && progress) progress({"done", files.size(), files.size(), db_path});
+    return ok;
+}
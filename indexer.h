@@ -0,0 +1,36 @@
+#pragma once
+#include <Python.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include "db.h"
+
+enum class Pass {
+    DECLARATIONS,
+    REFERENCES
+};
+
+//событие прогресса индексации: stage - scan/files/read/declarations/hierarchy/references/symbols/done
+struct IndexProgress {
+    std::string stage;
+    size_t done = 0;
+    size_t total = 0;
+    std::string file;
+};
+
+using ProgressFn = std::function<void(const IndexProgress&)>;
+
+bool create_project_db(const std::string& db_path);
+std::string read_python_file(const std::string& path);
+std::vector<std::string> scan_source_files(const std::string& project_path);
+
+//исходники читаются параллельно в jobs потоков, GIL не нужен
+std::vector<std::string> read_sources(const std::vector<File>& files, int jobs);
+
+//вызывать с захваченным GIL; false - запись в БД не удалась, проход остановлен
+bool parse_project(DB& db, const std::vector<File>& files, const std::vector<std::string>& sources, Pass pass, const ProgressFn& progress = nullptr);
+
+//полная индексация проекта в db_path, вызывать без GIL
+//если интерпретатор не запущен - поднимает свой (pysec), иначе использует текущий (analyzer)
+//одна транзакция: false - ошибка записи, прежний индекс в БД не тронут
+bool index_project(const std::string& project_path, const std::string& db_path, int jobs = 1, const ProgressFn& progress = nullptr);
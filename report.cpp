@@ -0,0 +1,166 @@
+#include "report.h"
+#include "db.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+static std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+static std::string default_output(const ReportTask& t, const std::string& db_path) {
+    if (t.kind == "files") return "files.txt";
+    if (t.kind == "call_graph") return "call_graph.dot";
+    if (t.kind == "inheritance") return "inheritance.dot";
+    if (t.kind == "ents") return t.arg + ".ents.txt";
+    if (t.kind == "imports") return "used_libraries.txt";
+    if (t.kind == "dangerous") return "dangerous.txt";
+    if (t.kind == "dead_code") return "dead_code.txt";
+    if (t.kind == "rollup") return "rollup_" + t.arg + ".dot";
+    if (t.kind == "import_graph") return "imports.dot";
+    if (t.kind == "snapshot") return db_path + ".snap";
+    return "";
+}
+
+std::vector<ReportTask> parse_report_spec(const std::string& spec) {
+    std::string text = spec;
+    //файл только явно через @, иначе файл с именем задачи в cwd подменял бы спецификацию
+    if (!spec.empty() && spec[0] == '@') {
+        std::ifstream in(spec.substr(1));
+        if (!in.is_open()) {
+            std::cerr << "cannot open spec file: " << spec.substr(1) << "\n";
+            return {};
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        text = buffer.str();
+    }
+    std::replace(text.begin(), text.end(), '\n', ',');
+
+    std::vector<ReportTask> tasks;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item = trim(item);
+        if (item.empty() || item[0] == '#') continue;
+        ReportTask t;
+        size_t eq = item.find('=');
+        if (eq != std::string::npos) {
+            t.output = trim(item.substr(eq + 1));
+            item = trim(item.substr(0, eq));
+        }
+        size_t colon = item.find(':');
+        t.kind = item.substr(0, colon);
+        if (colon != std::string::npos) t.arg = item.substr(colon + 1);
+        tasks.push_back(t);
+    }
+    return tasks;
+}
+
+//список строк в файл, как в get_all_imports
+template <typename T, typename Fmt>
+static bool write_lines(const std::string& path, const std::vector<T>& rows, Fmt fmt) {
+    std::ofstream out(path);
+    if (!out.is_open()) return false;
+    for (const auto& r : rows) out << fmt(r) << "\n";
+    out.close();
+    return static_cast<bool>(out);
+}
+
+static std::string run_task(DB& db, const ReportTask& t) {
+    if (t.kind == "files") {
+        if (!write_lines(t.output, db.files(), [](const File& f) { return f.path; })) return "cannot write " + t.output;
+    } else if (t.kind == "call_graph") {
+        if (!db.create_call_graph(t.output)) return "cannot write " + t.output;
+    } else if (t.kind == "inheritance") {
+        if (!db.create_graph(t.output)) return "cannot write " + t.output;
+    } else if (t.kind == "ents") {
+        //несколько файлов через ;
+        std::vector<std::string> patterns;
+        std::stringstream ss(t.arg);
+        std::string p;
+        while (std::getline(ss, p, ';')) if (!p.empty()) patterns.push_back(p);
+        if (patterns.empty()) return "ents needs a file: ents:<file>";
+        if (!db.ents(patterns, true, t.output)) return "no matching files or cannot write " + t.output;
+    } else if (t.kind == "imports") {
+        if (!db.save_imports(t.output)) return "cannot write " + t.output;
+    } else if (t.kind == "dangerous") {
+        auto fmt = [](const DangerousCall& d) { return d.function + " " + d.from + " " + d.file + ":" + std::to_string(d.line); };
+        if (!write_lines(t.output, db.get_dangerous(), fmt)) return "cannot write " + t.output;
+    } else if (t.kind == "dead_code") {
+        std::vector<std::string> roots;
+        std::stringstream ss(t.arg);
+        std::string r;
+        while (std::getline(ss, r, ';')) if (!r.empty()) roots.push_back(r);
+        auto fmt = [](const DeadSymbol& d) {
+            return d.kind + " " + d.name + " " + d.file + ":" + std::to_string(d.start_line) + "-" + std::to_string(d.end_line);
+        };
+        if (!write_lines(t.output, db.dead_code(roots), fmt)) return "cannot write " + t.output;
+    } else if (t.kind == "rollup") {
+        if (t.arg.empty()) return "rollup needs a level: rollup:<class|file|module|package>";
+        if (!db.create_rollup_graph(t.arg, t.output)) return "cannot write " + t.output;
+    } else if (t.kind == "import_graph") {
+        if (!db.create_import_graph(t.output)) return "cannot write " + t.output;
+    } else if (t.kind == "snapshot") {
+        if (!db.export_snapshot(t.output)) return "cannot write " + t.output;
+    } else {
+        return "unknown report: " + t.kind;
+    }
+    return "";
+}
+
+//примерная стоимость, тяжелые задачи стартуют первыми и не остаются хвостом
+static int task_weight(const std::string& kind) {
+    static const std::unordered_map<std::string, int> weights = {
+        {"call_graph", 9}, {"snapshot", 8}, {"dead_code", 8}, {"rollup", 7}, {"inheritance", 6},
+        {"dangerous", 5}, {"import_graph", 4}, {"ents", 3}, {"imports", 2}, {"files", 1},
+    };
+    auto it = weights.find(kind);
+    return it == weights.end() ? 0 : it->second;
+}
+
+std::vector<ReportResult> run_report(const std::string& db_path, const std::vector<ReportTask>& tasks, int jobs) {
+    std::vector<ReportResult> results(tasks.size());
+    if (tasks.empty()) return results;
+    if (jobs <= 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::min<int>(jobs, tasks.size());
+
+    std::vector<size_t> order(tasks.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return task_weight(tasks[a].kind) > task_weight(tasks[b].kind); });
+
+    //read-only соединения делят страницы файла через mmap (mmap_size), база с диска читается один раз
+    auto pool = std::make_shared<DBPool>(db_path, jobs, OpenMode::READ_ONLY);
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        auto db = pool->acquire();
+        for (size_t n = next++; n < order.size(); n = next++) {
+            ReportTask t = tasks[order[n]];
+            if (t.output.empty()) t.output = default_output(t, db_path);
+            auto start = std::chrono::steady_clock::now();
+            std::string error;
+            try {
+                error = run_task(*db, t);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            results[order[n]] = {t.kind, t.output, error.empty(), error, seconds};
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int j = 1; j < jobs; j++) threads.emplace_back(worker);
+    worker();
+    for (auto& th : threads) th.join();
+    return results;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <vector>
+
+//одна задача отчета: kind[:arg]=output
+//kind: files, call_graph, inheritance, ents, imports, dangerous, dead_code, rollup, import_graph, snapshot
+struct ReportTask {
+    std::string kind;
+    std::string arg;
+    std::string output;
+};
+
+struct ReportResult {
+    std::string kind;
+    std::string output;
+    bool ok;
+    std::string error;
+    double seconds;
+};
+
+//спецификация через запятую или по строкам, либо @путь к файлу с ней
+//пример: call_graph=cg.dot,inheritance,ents:ms_manager.py,imports=used_libraries.txt,rollup:module=mod.json
+std::vector<ReportTask> parse_report_spec(const std::string& spec);
+
+//задачи выполняются параллельно на jobs потоках (0 - по числу ядер), у каждого потока свое read-only соединение
+std::vector<ReportResult> run_report(const std::string& db_path, const std::vector<ReportTask>& tasks, int jobs = 0);
@@ -0,0 +1,385 @@
+#include "snapshot.h"
+#include <sqlite3.h>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char SNAP_MAGIC[8] = {'M', 'Y', 'U', 'S', 'N', 'A', 'P', '\0'};
+
+//пул строк снимка с дедупликацией
+struct SnapStrings {
+    std::string data;
+    std::vector<uint32_t> offsets{0};
+    std::unordered_map<std::string, uint32_t> index;
+
+    uint32_t add(const char* s) {
+        std::string key = s ? s : "";
+        auto it = index.find(key);
+        if (it != index.end()) return it->second;
+        uint32_t id = (uint32_t)offsets.size() - 1;
+        data += key;
+        offsets.push_back((uint32_t)data.size());
+        index.emplace(std::move(key), id);
+        return id;
+    }
+};
+
+//CSR из списка ребер (src, dst) по индексам, дубликаты убираются
+static void build_csr(size_t n, std::vector<std::pair<uint32_t, uint32_t>>& edges, std::vector<uint32_t>& offsets, std::vector<uint32_t>& targets) {
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    offsets.assign(n + 1, 0);
+    for (const auto& e : edges) offsets[e.first + 1]++;
+    for (size_t i = 0; i < n; i++) offsets[i + 1] += offsets[i];
+    targets.resize(edges.size());
+    for (size_t i = 0; i < edges.size(); i++) targets[i] = edges[i].second;
+}
+
+static const char* text(sqlite3_stmt* stmt, int col) {
+    return reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+}
+
+bool DB::export_snapshot(const std::string& path) {
+    if (!conn) return false;
+
+    SnapStrings strings;
+    std::vector<int32_t> file_ids, class_ids, func_ids, class_lines, func_lines;
+    std::vector<uint32_t> file_paths, class_names, class_files, func_names, func_classes, func_files;
+    std::unordered_map<int, uint32_t> file_idx, class_idx, func_idx;
+    std::vector<std::pair<uint32_t, uint32_t>> calls, inherits;
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(conn, "SELECT id, path FROM files ORDER BY id;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            file_idx[sqlite3_column_int(stmt, 0)] = (uint32_t)file_ids.size();
+            file_ids.push_back(sqlite3_column_int(stmt, 0));
+            file_paths.push_back(strings.add(text(stmt, 1)));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    auto index_of = [](const std::unordered_map<int, uint32_t>& m, int id) {
+        auto it = m.find(id);
+        return it == m.end() ? SNAP_NONE : it->second;
+    };
+
+    if (sqlite3_prepare_v2(conn, "SELECT id, name, file_id, start_line, end_line FROM classes ORDER BY id;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            class_idx[sqlite3_column_int(stmt, 0)] = (uint32_t)class_ids.size();
+            class_ids.push_back(sqlite3_column_int(stmt, 0));
+            class_names.push_back(strings.add(text(stmt, 1)));
+            class_files.push_back(index_of(file_idx, sqlite3_column_int(stmt, 2)));
+            class_lines.push_back(sqlite3_column_int(stmt, 3));
+            class_lines.push_back(sqlite3_column_int(stmt, 4));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    if (sqlite3_prepare_v2(conn, "SELECT id, name, class_id, file_id, start_line, end_line FROM functions ORDER BY id;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            func_idx[sqlite3_column_int(stmt, 0)] = (uint32_t)func_ids.size();
+            func_ids.push_back(sqlite3_column_int(stmt, 0));
+            func_names.push_back(strings.add(text(stmt, 1)));
+            func_classes.push_back(index_of(class_idx, sqlite3_column_int(stmt, 2)));
+            func_files.push_back(index_of(file_idx, sqlite3_column_int(stmt, 3)));
+            func_lines.push_back(sqlite3_column_int(stmt, 4));
+            func_lines.push_back(sqlite3_column_int(stmt, 5));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    if (sqlite3_prepare_v2(conn, "SELECT from_id, to_id, kind FROM refs WHERE (kind = 'call' OR kind = 'inherit') AND to_id != 0;", -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            bool inherit = strcmp(text(stmt, 2), "inherit") == 0;
+            const auto& idx = inherit ? class_idx : func_idx;
+            uint32_t from = index_of(idx, sqlite3_column_int(stmt, 0));
+            uint32_t to = index_of(idx, sqlite3_column_int(stmt, 1));
+            if (from == SNAP_NONE || to == SNAP_NONE) continue;
+            (inherit ? inherits : calls).push_back({from, to});
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    std::vector<uint32_t> by_name(func_ids.size());
+    for (uint32_t i = 0; i < by_name.size(); i++) by_name[i] = i;
+    std::sort(by_name.begin(), by_name.end(), [&](uint32_t a, uint32_t b) {
+        return strings.data.compare(strings.offsets[func_names[a]], strings.offsets[func_names[a] + 1] - strings.offsets[func_names[a]],
+                                    strings.data, strings.offsets[func_names[b]], strings.offsets[func_names[b] + 1] - strings.offsets[func_names[b]]) < 0;
+    });
+
+    std::vector<uint32_t> call_offsets, call_targets, caller_offsets, caller_sources, base_offsets, base_targets;
+    build_csr(func_ids.size(), calls, call_offsets, call_targets);
+    for (auto& e : calls) std::swap(e.first, e.second);
+    build_csr(func_ids.size(), calls, caller_offsets, caller_sources);
+    build_csr(class_ids.size(), inherits, base_offsets, base_targets);
+
+    std::vector<SnapSink> sinks;
+    for (const auto& dc : get_dangerous()) {
+        sinks.push_back({strings.add(dc.function.c_str()), strings.add(dc.from.c_str()), dc.line, strings.add(dc.file.c_str())});
+    }
+
+    //раскладка: заголовок, таблица секций, данные
+    struct Blob { SnapSectionId id; const void* data; size_t size; };
+    std::vector<Blob> blobs = {
+        {SnapSectionId::STRING_DATA, strings.data.data(), strings.data.size()},
+        {SnapSectionId::STRING_OFFSETS, strings.offsets.data(), strings.offsets.size() * 4},
+        {SnapSectionId::FILE_IDS, file_ids.data(), file_ids.size() * 4},
+        {SnapSectionId::FILE_PATHS, file_paths.data(), file_paths.size() * 4},
+        {SnapSectionId::CLASS_IDS, class_ids.data(), class_ids.size() * 4},
+        {SnapSectionId::CLASS_NAMES, class_names.data(), class_names.size() * 4},
+        {SnapSectionId::CLASS_FILES, class_files.data(), class_files.size() * 4},
+        {SnapSectionId::CLASS_LINES, class_lines.data(), class_lines.size() * 4},
+        {SnapSectionId::FUNC_IDS, func_ids.data(), func_ids.size() * 4},
+        {SnapSectionId::FUNC_NAMES, func_names.data(), func_names.size() * 4},
+        {SnapSectionId::FUNC_CLASSES, func_classes.data(), func_classes.size() * 4},
+        {SnapSectionId::FUNC_FILES, func_files.data(), func_files.size() * 4},
+        {SnapSectionId::FUNC_LINES, func_lines.data(), func_lines.size() * 4},
+        {SnapSectionId::FUNC_BY_NAME, by_name.data(), by_name.size() * 4},
+        {SnapSectionId::CALL_OFFSETS, call_offsets.data(), call_offsets.size() * 4},
+        {SnapSectionId::CALL_TARGETS, call_targets.data(), call_targets.size() * 4},
+        {SnapSectionId::CALLER_OFFSETS, caller_offsets.data(), caller_offsets.size() * 4},
+        {SnapSectionId::CALLER_SOURCES, caller_sources.data(), caller_sources.size() * 4},
+        {SnapSectionId::BASE_OFFSETS, base_offsets.data(), base_offsets.size() * 4},
+        {SnapSectionId::BASE_TARGETS, base_targets.data(), base_targets.size() * 4},
+        {SnapSectionId::SINKS, sinks.data(), sinks.size() * sizeof(SnapSink)},
+    };
+
+    SnapHeader header;
+    memcpy(header.magic, SNAP_MAGIC, sizeof(header.magic));
+    header.version = SNAP_VERSION;
+    header.sections = (uint32_t)blobs.size();
+
+    std::vector<SnapSection> table;
+    uint64_t offset = sizeof(SnapHeader) + blobs.size() * sizeof(SnapSection);
+    for (const auto& b : blobs) {
+        offset = (offset + 7) & ~uint64_t(7);
+        table.push_back({(uint32_t)b.id, 0, offset, b.size});
+        offset += b.size;
+    }
+
+    //пишем во временный файл и переименовываем: открытые mmap старого снимка остаются валидными
+    std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "cannot write snapshot: " << tmp << "\n";
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(SnapSection));
+    static const char zeros[8] = {};
+    for (size_t i = 0; i < blobs.size(); i++) {
+        out.write(zeros, table[i].offset - (uint64_t)out.tellp());
+        if (blobs[i].size) out.write(static_cast<const char*>(blobs[i].data), blobs[i].size);
+    }
+    out.close();
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "cannot write snapshot: " << path << "\n";
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+Snapshot::Snapshot(const std::string& path) {
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "cannot open snapshot: " << path << "\n";
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapHeader)) {
+        std::cerr << "bad snapshot: " << path << "\n";
+        return;
+    }
+
+    //MAP_SHARED: процессы на одном хосте делят страницы кэша
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        std::cerr << "cannot mmap snapshot: " << path << "\n";
+        return;
+    }
+    base = static_cast<const char*>(p);
+    length = st.st_size;
+
+    const SnapHeader* header = reinterpret_cast<const SnapHeader*>(base);
+    bool valid = memcmp(header->magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) == 0 && header->version == SNAP_VERSION &&
+                 sizeof(SnapHeader) + header->sections * sizeof(SnapSection) <= length;
+    if (valid) {
+        const SnapSection* table = reinterpret_cast<const SnapSection*>(base + sizeof(SnapHeader));
+        for (uint32_t i = 0; i < header->sections; i++) {
+            if (table[i].offset > length || table[i].size > length - table[i].offset || table[i].offset % 8 != 0) { valid = false; break; }
+            if (table[i].id < (uint32_t)SnapSectionId::COUNT) sections[table[i].id] = &table[i];
+        }
+    }
+    valid = valid && check_counts();
+    if (!valid) {
+        std::cerr << "bad snapshot: " << path << "\n";
+        std::fill(std::begin(sections), std::end(sections), nullptr);
+        munmap(const_cast<char*>(base), length);
+        base = nullptr;
+        length = 0;
+    }
+}
+
+//размеры секций должны сходиться между собой, иначе доступ по индексу уходит за массив
+bool Snapshot::check_counts() const {
+    for (const SnapSection* s : sections) {
+        if (!s) return false;
+    }
+    size_t files, classes, funcs, n;
+    array<int32_t>(SnapSectionId::FILE_IDS, &files);
+    array<int32_t>(SnapSectionId::CLASS_IDS, &classes);
+    array<int32_t>(SnapSectionId::FUNC_IDS, &funcs);
+
+    auto count_is = [&](SnapSectionId id, size_t expected) {
+        array<uint32_t>(id, &n);
+        return n == expected;
+    };
+    array<uint32_t>(SnapSectionId::STRING_OFFSETS, &n);
+    return n >= 1 &&
+           count_is(SnapSectionId::FILE_PATHS, files) &&
+           count_is(SnapSectionId::CLASS_NAMES, classes) &&
+           count_is(SnapSectionId::CLASS_FILES, classes) &&
+           count_is(SnapSectionId::CLASS_LINES, classes * 2) &&
+           count_is(SnapSectionId::FUNC_NAMES, funcs) &&
+           count_is(SnapSectionId::FUNC_CLASSES, funcs) &&
+           count_is(SnapSectionId::FUNC_FILES, funcs) &&
+           count_is(SnapSectionId::FUNC_LINES, funcs * 2) &&
+           count_is(SnapSectionId::FUNC_BY_NAME, funcs) &&
+           count_is(SnapSectionId::CALL_OFFSETS, funcs + 1) &&
+           count_is(SnapSectionId::CALLER_OFFSETS, funcs + 1) &&
+           count_is(SnapSectionId::BASE_OFFSETS, classes + 1);
+}
+
+Snapshot::~Snapshot() {
+    if (base) munmap(const_cast<char*>(base), length);
+    if (fd >= 0) close(fd);
+}
+
+size_t Snapshot::file_count() const {
+    size_t n;
+    array<int32_t>(SnapSectionId::FILE_IDS, &n);
+    return n;
+}
+
+size_t Snapshot::class_count() const {
+    size_t n;
+    array<int32_t>(SnapSectionId::CLASS_IDS, &n);
+    return n;
+}
+
+size_t Snapshot::function_count() const {
+    size_t n;
+    array<int32_t>(SnapSectionId::FUNC_IDS, &n);
+    return n;
+}
+
+std::string_view Snapshot::str(uint32_t i) const {
+    size_t n;
+    const uint32_t* offsets = array<uint32_t>(SnapSectionId::STRING_OFFSETS, &n);
+    size_t data_size;
+    const char* data = array<char>(SnapSectionId::STRING_DATA, &data_size);
+    if (i == SNAP_NONE || i + 1 >= n) return {};
+    //смещения проверяются при обращении, чтобы открытие не читало весь пул
+    if (offsets[i] > offsets[i + 1] || offsets[i + 1] > data_size) return {};
+    return std::string_view(data + offsets[i], offsets[i + 1] - offsets[i]);
+}
+
+std::string_view Snapshot::file_path(uint32_t file) const {
+    if (file >= file_count()) return {};
+    return str(array<uint32_t>(SnapSectionId::FILE_PATHS)[file]);
+}
+
+std::string_view Snapshot::class_name(uint32_t cls) const {
+    if (cls >= class_count()) return {};
+    return str(array<uint32_t>(SnapSectionId::CLASS_NAMES)[cls]);
+}
+
+std::string_view Snapshot::function_name(uint32_t func) const {
+    if (func >= function_count()) return {};
+    return str(array<uint32_t>(SnapSectionId::FUNC_NAMES)[func]);
+}
+
+std::string Snapshot::qualified(uint32_t func) const {
+    if (func >= function_count()) return "";
+    uint32_t cls = array<uint32_t>(SnapSectionId::FUNC_CLASSES)[func];
+    std::string name(function_name(func));
+    return cls == SNAP_NONE ? name : std::string(class_name(cls)) + "." + name;
+}
+
+int Snapshot::function_id(uint32_t func) const {
+    return func < function_count() ? array<int32_t>(SnapSectionId::FUNC_IDS)[func] : 0;
+}
+
+uint32_t Snapshot::function_file(uint32_t func) const {
+    return func < function_count() ? array<uint32_t>(SnapSectionId::FUNC_FILES)[func] : SNAP_NONE;
+}
+
+int Snapshot::function_line(uint32_t func) const {
+    return func < function_count() ? array<int32_t>(SnapSectionId::FUNC_LINES)[func * 2] : 0;
+}
+
+uint32_t Snapshot::function_index(int id) const {
+    size_t n;
+    const int32_t* ids = array<int32_t>(SnapSectionId::FUNC_IDS, &n);
+    if (!ids) return SNAP_NONE;
+    const int32_t* it = std::lower_bound(ids, ids + n, id);
+    return (it != ids + n && *it == id) ? (uint32_t)(it - ids) : SNAP_NONE;
+}
+
+std::vector<uint32_t> Snapshot::find_functions(std::string_view name) const {
+    size_t n;
+    const uint32_t* by_name = array<uint32_t>(SnapSectionId::FUNC_BY_NAME, &n);
+    if (!by_name) return {};
+    auto range = std::equal_range(by_name, by_name + n, name, [&](auto a, auto b) {
+        if constexpr (std::is_same_v<decltype(a), std::string_view>) return a < function_name(b);
+        else return function_name(a) < b;
+    });
+    return std::vector<uint32_t>(range.first, range.second);
+}
+
+IndexSpan Snapshot::csr(SnapSectionId offsets_id, SnapSectionId targets_id, uint32_t i) const {
+    size_t n, targets_n;
+    const uint32_t* offsets = array<uint32_t>(offsets_id, &n);
+    const uint32_t* targets = array<uint32_t>(targets_id, &targets_n);
+    if (!offsets || i + 1 >= n) return {};
+    if (offsets[i] > offsets[i + 1] || offsets[i + 1] > targets_n) return {};
+    return {targets + offsets[i], targets + offsets[i + 1]};
+}
+
+IndexSpan Snapshot::callees(uint32_t func) const {
+    return csr(SnapSectionId::CALL_OFFSETS, SnapSectionId::CALL_TARGETS, func);
+}
+
+IndexSpan Snapshot::callers(uint32_t func) const {
+    return csr(SnapSectionId::CALLER_OFFSETS, SnapSectionId::CALLER_SOURCES, func);
+}
+
+IndexSpan Snapshot::bases(uint32_t cls) const {
+    return csr(SnapSectionId::BASE_OFFSETS, SnapSectionId::BASE_TARGETS, cls);
+}
+
+std::vector<File> Snapshot::files() const {
+    std::vector<File> result;
+    const int32_t* ids = array<int32_t>(SnapSectionId::FILE_IDS);
+    for (size_t i = 0; i < file_count(); i++) result.push_back({ids[i], std::string(file_path(i))});
+    return result;
+}
+
+std::vector<DangerousCall> Snapshot::get_dangerous() const {
+    size_t n;
+    const SnapSink* sinks = array<SnapSink>(SnapSectionId::SINKS, &n);
+    std::vector<DangerousCall> result;
+    result.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        result.push_back({std::string(str(sinks[i].function)), std::string(str(sinks[i].from)), sinks[i].line, std::string(str(sinks[i].file))});
+    }
+    return result;
+}
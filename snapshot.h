@@ -0,0 +1,119 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "db.h"
+
+//бинарный снимок БД (.myund.snap), читается через mmap без разбора
+//заголовок, таблица секций, дальше секции с выравниванием 8 байт
+//все массивы uint32/int32 в порядке байт хоста, строки - общий пул со смещениями
+//индексы внутри снимка - позиции в отсортированных по id массивах, не id из sqlite
+
+enum class SnapSectionId : uint32_t {
+    STRING_DATA,
+    STRING_OFFSETS,   //n + 1 смещений в STRING_DATA
+    FILE_IDS,
+    FILE_PATHS,
+    CLASS_IDS,
+    CLASS_NAMES,
+    CLASS_FILES,
+    CLASS_LINES,      //пары start, end
+    FUNC_IDS,
+    FUNC_NAMES,
+    FUNC_CLASSES,     //индекс класса или SNAP_NONE
+    FUNC_FILES,
+    FUNC_LINES,
+    FUNC_BY_NAME,     //индексы функций, отсортированные по имени
+    CALL_OFFSETS,     //CSR вызовов: функция -> функции
+    CALL_TARGETS,
+    CALLER_OFFSETS,   //обратный CSR
+    CALLER_SOURCES,
+    BASE_OFFSETS,     //CSR наследования: класс -> прямые базы
+    BASE_TARGETS,
+    SINKS,            //SnapSink, как get_dangerous
+    COUNT
+};
+
+constexpr uint32_t SNAP_NONE = 0xFFFFFFFF;
+constexpr uint32_t SNAP_VERSION = 1;
+
+struct SnapHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sections;
+};
+
+struct SnapSection {
+    uint32_t id;
+    uint32_t pad;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct SnapSink {
+    uint32_t function;
+    uint32_t from;
+    int32_t line;
+    uint32_t file;
+};
+
+//непрерывный кусок массива внутри mmap
+struct IndexSpan {
+    const uint32_t* first = nullptr;
+    const uint32_t* last = nullptr;
+
+    const uint32_t* begin() const { return first; }
+    const uint32_t* end() const { return last; }
+    size_t size() const { return last - first; }
+};
+
+class Snapshot {
+private:
+    int fd = -1;
+    const char* base = nullptr;
+    size_t length = 0;
+    const SnapSection* sections[(size_t)SnapSectionId::COUNT] = {};
+
+    template <typename T>
+    const T* array(SnapSectionId id, size_t* count = nullptr) const {
+        const SnapSection* s = sections[(size_t)id];
+        if (count) *count = s ? s->size / sizeof(T) : 0;
+        return s ? reinterpret_cast<const T*>(base + s->offset) : nullptr;
+    }
+    IndexSpan csr(SnapSectionId offsets, SnapSectionId targets, uint32_t i) const;
+    bool check_counts() const;
+
+public:
+    //открытие - mmap и проверка заголовка, данные подгружаются страницами по обращению
+    explicit Snapshot(const std::string& path);
+    ~Snapshot();
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    bool ok() const { return base != nullptr; }
+
+    size_t file_count() const;
+    size_t class_count() const;
+    size_t function_count() const;
+
+    std::string_view str(uint32_t i) const;
+    std::string_view file_path(uint32_t file) const;
+    std::string_view class_name(uint32_t cls) const;
+    std::string_view function_name(uint32_t func) const;
+    std::string qualified(uint32_t func) const;
+    int function_id(uint32_t func) const;
+    uint32_t function_file(uint32_t func) const;
+    int function_line(uint32_t func) const;
+
+    //поиск по id бинарным поиском, SNAP_NONE если нет
+    uint32_t function_index(int id) const;
+    std::vector<uint32_t> find_functions(std::string_view name) const;
+
+    IndexSpan callees(uint32_t func) const;
+    IndexSpan callers(uint32_t func) const;
+    IndexSpan bases(uint32_t cls) const;
+
+    std::vector<File> files() const;
+    std::vector<DangerousCall> get_dangerous() const;
+};
@@ -0,0 +1,456 @@
+#include "tracelog.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+static const char TRACE_MAGIC[8] = {'P', 'Y', 'S', 'T', 'R', 'A', 'C', 'E'};
+
+//каждый TraceLog получает свое поколение, чтобы thread_local кольца не пережили лог
+static std::atomic<uint64_t> g_trace_generation{0};
+
+static uint64_t current_thread_id() {
+    return (uint64_t)syscall(SYS_gettid);
+}
+
+bool TraceRing::push(const void* a, size_t na, const void* b, size_t nb) {
+    size_t n = na + nb;
+    size_t cap = data.size();
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint64_t t = tail.load(std::memory_order_acquire);
+    //счетчики пишет только владелец кольца
+    if (cap - (h - t) < n) {
+        dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto copy_in = [&](uint64_t at, const void* src, size_t len) {
+        if (!len) return;
+        size_t pos = at % cap;
+        size_t first = std::min(len, cap - pos);
+        std::memcpy(data.data() + pos, src, first);
+        std::memcpy(data.data(), (const char*)src + first, len - first);
+    };
+    copy_in(h, a, na);
+    copy_in(h + na, b, nb);
+
+    head.store(h + n, std::memory_order_release);
+    events.store(events.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+}
+
+//строка JSON в кавычках; битый UTF-8 (обрезанное значение аргумента) заменяется на U+FFFD
+static void json_string(std::string& out, const char* p, size_t n) {
+    out += '"';
+    for (size_t i = 0; i < n;) {
+        unsigned char c = (unsigned char)p[i];
+        if (c < 0x80) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += (char)c;
+            } else if (c == '\n') {
+                out += "\\n";
+            } else if (c < 0x20 || c == 0x7f) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += (char)c;
+            }
+            i++;
+            continue;
+        }
+        size_t len = (c >= 0xC2 && c <= 0xDF) ? 2 : (c >= 0xE0 && c <= 0xEF) ? 3 : (c >= 0xF0 && c <= 0xF4) ? 4 : 0;
+        bool valid = len && i + len <= n;
+        for (size_t k = 1; valid && k < len; k++) valid = ((unsigned char)p[i + k] & 0xC0) == 0x80;
+        if (valid) {
+            out.append(p + i, len);
+            i += len;
+        } else {
+            out += "\xEF\xBF\xBD";
+            i++;
+        }
+    }
+    out += '"';
+}
+
+TraceLog::TraceLog(const std::string& path, TraceFormat format, size_t ring_bytes)
+    : format(format), generation(++g_trace_generation), ring_bytes(ring_bytes), start(std::chrono::steady_clock::now()) {
+    out = fopen(path.c_str(), "wb");
+    if (!out) {
+        std::cerr << "cant open trace log: " << path << "\n";
+        return;
+    }
+    setvbuf(out, nullptr, _IOFBF, 1 << 20);
+
+    if (format == TraceFormat::CHROME) {
+        //закрывающая ] в Array Format необязательна: файл упавшего процесса тоже открывается
+        fputs("[\n", out);
+    } else {
+        TraceHeader header{};
+        std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+        header.version = TRACE_VERSION;
+        header.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        fwrite(&header, sizeof(header), 1, out);
+    }
+
+    writer = std::thread([this] {
+        while (true) {
+            size_t n = drain();
+            std::unique_lock<std::mutex> lk(wake_mtx);
+            if (stopping) break;
+            if (!n) wake.wait_for(lk, std::chrono::milliseconds(2));
+        }
+    });
+}
+
+TraceLog::~TraceLog() {
+    close();
+}
+
+//кольцо потока для этого лога: по слоту на поколение, одновременно открыты -log и -trace-out
+//при нехватке слотов вытесняется самое старое поколение - это уже закрытый лог
+TraceRing* TraceLog::ring() {
+    struct Cached {
+        uint64_t generation = 0;
+        TraceRing* ring = nullptr;
+    };
+    static thread_local Cached cached[4];
+    Cached* slot = &cached[0];
+    for (auto& c : cached) {
+        if (c.generation == generation) return c.ring;
+        if (c.generation < slot->generation) slot = &c;
+    }
+
+    auto r = std::make_unique<TraceRing>(ring_bytes, current_thread_id());
+    slot->ring = r.get();
+    slot->generation = generation;
+    std::lock_guard<std::mutex> lk(rings_mtx);
+    rings.push_back(std::move(r));
+    return slot->ring;
+}
+
+void TraceLog::event(TraceKind kind, uint32_t code, const char* args, size_t args_len, uint64_t span) {
+    if (!out) return;
+    TraceEvent e;
+    e.time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    e.span = span;
+    e.code = code;
+    e.kind = (uint8_t)kind;
+    e.pad = 0;
+    e.args = (uint16_t)std::min<size_t>(args_len, 0xFFFF);
+    ring()->push(&e, sizeof(e), args, e.args);
+}
+
+void TraceLog::code(uint32_t id, const std::string& qualified, const std::string& filename, int line) {
+    std::lock_guard<std::mutex> lk(codes_mtx);
+    if (format == TraceFormat::CHROME) {
+        if (names.size() <= id) names.resize(id + 1);
+        names[id] = qualified;
+        return;
+    }
+    int32_t l = line;
+    codes.append((const char*)&id, sizeof(id));
+    codes.append((const char*)&l, sizeof(l));
+    codes.append(qualified.c_str(), qualified.size() + 1);
+    codes.append(filename.c_str(), filename.size() + 1);
+}
+
+void TraceLog::thread_name(uint64_t thread, const std::string& name) {
+    std::lock_guard<std::mutex> lk(codes_mtx);
+    thread_names.emplace_back(thread, name);
+}
+
+void TraceLog::write_chunk(TraceChunk kind, uint64_t thread, const char* a, size_t na, const char* b, size_t nb) {
+    TraceChunkHeader h{(uint32_t)kind, (uint32_t)(na + nb), thread};
+    fwrite(&h, sizeof(h), 1, out);
+    if (na) fwrite(a, 1, na, out);
+    if (nb) fwrite(b, 1, nb, out);
+}
+
+void TraceLog::write_json_event(const std::string& event) {
+    if (!first_json) fputs(",\n", out);
+    first_json = false;
+    fwrite(event.data(), 1, event.size(), out);
+}
+
+//события одного кольца в Trace Event Format: отрезки вызовов - B/E на своем потоке,
+//вся жизнь корутины от первого входа до выхода - асинхронный b/e с id, через все await
+void TraceLog::write_json(uint64_t thread, const char* data, size_t n) {
+    std::lock_guard<std::mutex> lk(codes_mtx);
+    std::string common = ",\"pid\":" + std::to_string(getpid()) + ",\"tid\":" + std::to_string(thread) + ",\"ts\":";
+    const char* p = data;
+    const char* end = data + n;
+    while (p + sizeof(TraceEvent) <= end) {
+        TraceEvent e;
+        std::memcpy(&e, p, sizeof(e));
+        p += sizeof(e);
+        const char* args = p;
+        size_t args_len = std::min<size_t>(e.args, end - p);
+        p += args_len;
+
+        std::string name;
+        if (e.code < names.size()) json_string(name, names[e.code].data(), names[e.code].size());
+        else name = "\"<code " + std::to_string(e.code) + ">\"";
+        char ts[32];
+        snprintf(ts, sizeof(ts), "%.3f", e.time / 1e3);
+        char span[32];
+        snprintf(span, sizeof(span), "\"0x%llx\"", (unsigned long long)e.span);
+
+        bool begin = e.kind == (uint8_t)TraceKind::CALL || e.kind == (uint8_t)TraceKind::RESUME;
+        json.clear();
+        json += "{\"name\":" + name + ",\"cat\":\"python\",\"ph\":\"" + (begin ? "B" : "E") + "\"" + common + ts;
+        if (args_len) {
+            //"name: value" построчно -> объект args
+            json += ",\"args\":{";
+            const char* line = args;
+            const char* args_end = args + args_len;
+            bool first = true;
+            while (line < args_end) {
+                const char* eol = std::find(line, args_end, '\n');
+                const char* sep = std::search(line, eol, ": ", ": " + 2);
+                if (eol > line) {
+                    if (!first) json += ",";
+                    first = false;
+                    json_string(json, line, sep - line);
+                    json += ":";
+                    if (sep < eol) json_string(json, sep + 2, eol - sep - 2);
+                    else json += "\"\"";
+                }
+                line = eol + 1;
+            }
+            json += "}";
+        } else if (e.kind == (uint8_t)TraceKind::UNWIND) {
+            json += ",\"args\":{\"exception\":true}";
+        }
+        json += "}";
+
+        if (e.span && e.kind == (uint8_t)TraceKind::CALL) {
+            write_json_event("{\"name\":" + name + ",\"cat\":\"coroutine\",\"ph\":\"b\",\"id\":" + span + common + ts + "}");
+        }
+        write_json_event(json);
+        if (e.span && (e.kind == (uint8_t)TraceKind::RETURN || e.kind == (uint8_t)TraceKind::UNWIND)) {
+            write_json_event("{\"name\":" + name + ",\"cat\":\"coroutine\",\"ph\":\"e\",\"id\":" + span + common + ts + "}");
+        }
+    }
+}
+
+//все накопленное из колец одним куском на кольцо, только из потока писателя или после его остановки
+size_t TraceLog::drain() {
+    std::lock_guard<std::mutex> lk(rings_mtx);
+    size_t total = 0;
+    for (auto& r : rings) {
+        uint64_t h = r->head.load(std::memory_order_acquire);
+        uint64_t t = r->tail.load(std::memory_order_relaxed);
+        if (h == t) continue;
+
+        size_t cap = r->data.size();
+        size_t n = h - t;
+        size_t pos = t % cap;
+        size_t first = std::min(n, cap - pos);
+        if (format == TraceFormat::CHROME) {
+            scratch.assign(r->data.data() + pos, r->data.data() + pos + first);
+            scratch.insert(scratch.end(), r->data.data(), r->data.data() + (n - first));
+            write_json(r->thread, scratch.data(), n);
+        } else {
+            write_chunk(TraceChunk::EVENTS, r->thread, r->data.data() + pos, first, r->data.data(), n - first);
+        }
+        r->tail.store(h, std::memory_order_release);
+        total += n;
+    }
+    return total;
+}
+
+void TraceLog::close() {
+    if (!out) return;
+    {
+        std::lock_guard<std::mutex> lk(wake_mtx);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (writer.joinable()) writer.join();
+    drain();
+
+    if (format == TraceFormat::CHROME) {
+        std::lock_guard<std::mutex> lk(codes_mtx);
+        for (const auto& t : thread_names) {
+            json.clear();
+            json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + std::to_string(getpid()) + ",\"tid\":" + std::to_string(t.first) + ",\"args\":{\"name\":";
+            json_string(json, t.second.data(), t.second.size());
+            json += "}}";
+            write_json_event(json);
+        }
+        fputs("\n]\n", out);
+        fclose(out);
+        out = nullptr;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(codes_mtx);
+        write_chunk(TraceChunk::CODES, 0, codes.data(), codes.size());
+    }
+    std::vector<uint64_t> stats;
+    {
+        std::lock_guard<std::mutex> lk(rings_mtx);
+        for (auto& r : rings) {
+            stats.push_back(r->thread);
+            stats.push_back(r->events.load(std::memory_order_relaxed));
+            stats.push_back(r->dropped.load(std::memory_order_relaxed));
+        }
+    }
+    write_chunk(TraceChunk::THREADS, 0, (const char*)stats.data(), stats.size() * sizeof(uint64_t));
+
+    fclose(out);
+    out = nullptr;
+}
+
+uint64_t TraceLog::events() {
+    std::lock_guard<std::mutex> lk(rings_mtx);
+    uint64_t n = 0;
+    for (auto& r : rings) n += r->events.load(std::memory_order_relaxed);
+    return n;
+}
+
+uint64_t TraceLog::dropped() {
+    std::lock_guard<std::mutex> lk(rings_mtx);
+    uint64_t n = 0;
+    for (auto& r : rings) n += r->dropped.load(std::memory_order_relaxed);
+    return n;
+}
+
+struct DecodedCode {
+    std::string qualified;
+    std::string filename;
+    int line = 0;
+};
+
+bool decode_trace(const std::string& path, std::ostream& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "cant open trace: " << path << "\n";
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    TraceHeader header;
+    if (data.size() < sizeof(header)) {
+        std::cerr << "bad trace: " << path << "\n";
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 || header.version != TRACE_VERSION) {
+        std::cerr << "bad trace: " << path << "\n";
+        return false;
+    }
+
+    //куски по порядку, обрезанный хвост (упавший процесс) просто отбрасывается
+    struct Chunk {
+        TraceChunkHeader header;
+        const char* body;
+    };
+    std::vector<Chunk> chunks;
+    size_t pos = sizeof(header);
+    while (pos + sizeof(TraceChunkHeader) <= data.size()) {
+        Chunk c;
+        std::memcpy(&c.header, data.data() + pos, sizeof(c.header));
+        pos += sizeof(c.header);
+        if (pos + c.header.size > data.size()) break;
+        c.body = data.data() + pos;
+        pos += c.header.size;
+        chunks.push_back(c);
+    }
+
+    //первый проход: коды и статистика, они в конце файла
+    std::unordered_map<uint32_t, DecodedCode> codes;
+    std::vector<uint64_t> stats;
+    for (const auto& c : chunks) {
+        if (c.header.kind == (uint32_t)TraceChunk::CODES) {
+            const char* p = c.body;
+            const char* end = c.body + c.header.size;
+            while (p + 8 <= end) {
+                uint32_t id;
+                int32_t line;
+                std::memcpy(&id, p, 4);
+                std::memcpy(&line, p + 4, 4);
+                p += 8;
+                DecodedCode code;
+                code.line = line;
+                code.qualified = std::string(p, strnlen(p, end - p));
+                p += code.qualified.size() + 1;
+                if (p > end) break;
+                code.filename = std::string(p, strnlen(p, end - p));
+                p += code.filename.size() + 1;
+                codes[id] = std::move(code);
+            }
+        } else if (c.header.kind == (uint32_t)TraceChunk::THREADS) {
+            stats.resize(c.header.size / sizeof(uint64_t));
+            std::memcpy(stats.data(), c.body, stats.size() * sizeof(uint64_t));
+        }
+    }
+
+    auto name = [&](uint32_t id) {
+        auto it = codes.find(id);
+        return it != codes.end() ? it->second.qualified : "<code " + std::to_string(id) + ">";
+    };
+
+    //второй проход: события, длительности по стеку вызовов своего потока
+    std::unordered_map<uint64_t, std::vector<std::pair<uint32_t, uint64_t>>> stacks;
+    size_t total = 0;
+    out << std::fixed << std::setprecision(3);
+    for (const auto& c : chunks) {
+        if (c.header.kind != (uint32_t)TraceChunk::EVENTS) continue;
+        auto& stack = stacks[c.header.thread];
+        const char* p = c.body;
+        const char* end = c.body + c.header.size;
+        while (p + sizeof(TraceEvent) <= end) {
+            TraceEvent e;
+            std::memcpy(&e, p, sizeof(e));
+            p += sizeof(e);
+            std::string args(p, std::min<size_t>(e.args, end - p));
+            p += args.size();
+            total++;
+
+            out << "[" << std::setw(12) << e.time / 1e6 << " ms] thread " << c.header.thread << " ";
+            if (e.kind == (uint8_t)TraceKind::RESUME) {
+                stack.emplace_back(e.code, e.time);
+                out << "RESUME " << name(e.code) << "\n";
+                continue;
+            }
+            if (e.kind == (uint8_t)TraceKind::CALL) {
+                stack.emplace_back(e.code, e.time);
+                out << "CALL " << name(e.code);
+                auto it = codes.find(e.code);
+                if (it != codes.end()) out << " (" << it->second.filename << ":" << it->second.line << ")";
+                out << "\n";
+                std::istringstream lines(args);
+                std::string line;
+                while (std::getline(lines, line)) out << "   " << line << "\n";
+                continue;
+            }
+
+            out << (e.kind == (uint8_t)TraceKind::UNWIND ? "UNWIND " : e.kind == (uint8_t)TraceKind::YIELD ? "YIELD " : "RETURN ") << name(e.code);
+            //при потерянных событиях снимаем стек до своего вызова
+            auto it = std::find_if(stack.rbegin(), stack.rend(), [&](const auto& f) { return f.first == e.code; });
+            if (it != stack.rend()) {
+                out << " " << (e.time - it->second) / 1e6 << " ms";
+                stack.erase(std::next(it).base(), stack.end());
+            }
+            out << "\n";
+        }
+    }
+
+    out << "\nEVENTS: " << total << "\n";
+    uint64_t dropped = 0;
+    for (size_t i = 0; i + 2 < stats.size(); i += 3) {
+        out << "   thread " << stats[i] << ": " << stats[i + 1] << " events, " << stats[i + 2] << " dropped\n";
+        dropped += stats[i + 2];
+    }
+    out << "DROPPED: " << dropped << "\n";
+    return true;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <ostream>
+
+//лог трассировки -run: бинарный .pytrace (-log) или Chrome Trace Event JSON (-trace-out)
+//.pytrace: заголовок, дальше куски: события одного потока, таблица кодов, статистика потоков
+//события пишутся в кольцевые буферы потоков без блокировок, на диск их сбрасывает фоновый поток
+
+enum class TraceKind : uint8_t {
+    CALL,
+    RETURN,
+    UNWIND,     //выход по исключению
+    RESUME,     //продолжение генератора/корутины после yield/await
+    YIELD       //приостановка генератора/корутины
+};
+
+enum class TraceFormat {
+    BINARY,     //.pytrace, читается --decode-trace
+    CHROME      //JSON Array Format: chrome://tracing, ui.perfetto.dev
+};
+
+enum class TraceChunk : uint32_t {
+    EVENTS,     //TraceEvent + args подряд
+    CODES,      //id, строки qualified и filename через \0, строка
+    THREADS     //поток, число событий, число потерянных
+};
+
+constexpr uint32_t TRACE_VERSION = 2;
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pad;
+    uint64_t start_ns;      //system_clock в момент старта, время событий - от него
+};
+
+struct TraceChunkHeader {
+    uint32_t kind;
+    uint32_t size;          //байт после заголовка
+    uint64_t thread;
+};
+
+struct TraceEvent {
+    uint64_t time;          //нс от старта
+    uint64_t span;          //корутина: id, общий для всех ее отрезков, иначе 0
+    uint32_t code;
+    uint8_t kind;
+    uint8_t pad;
+    uint16_t args;          //байт текста аргументов после события
+};
+
+//SPSC кольцо одного потока: пишет только свой поток, читает только фоновый писатель
+struct TraceRing {
+    std::vector<char> data;
+    uint64_t thread = 0;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> events{0};
+    std::atomic<uint64_t> dropped{0};
+
+    TraceRing(size_t bytes, uint64_t thread) : data(bytes), thread(thread) {}
+    bool push(const void* a, size_t na, const void* b, size_t nb);
+};
+
+class TraceLog {
+private:
+    FILE* out = nullptr;
+    TraceFormat format;
+    uint64_t generation;
+    size_t ring_bytes;
+    std::chrono::steady_clock::time_point start;
+
+    std::mutex rings_mtx;       //только регистрация колец и сброс, не путь события
+    std::vector<std::unique_ptr<TraceRing>> rings;
+    std::mutex codes_mtx;
+    std::string codes;
+    std::vector<std::string> names;     //по id, для JSON
+    std::vector<std::pair<uint64_t, std::string>> thread_names;
+
+    std::thread writer;
+    std::mutex wake_mtx;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    std::vector<char> scratch;  //JSON: события кольца подряд, без разрыва на границе
+    std::string json;
+    bool first_json = true;
+
+    TraceRing* ring();
+    size_t drain();
+    void write_chunk(TraceChunk kind, uint64_t thread, const char* a, size_t na, const char* b = nullptr, size_t nb = 0);
+    void write_json(uint64_t thread, const char* data, size_t n);
+    void write_json_event(const std::string& event);
+
+public:
+    explicit TraceLog(const std::string& path, TraceFormat format = TraceFormat::BINARY, size_t ring_bytes = 1 << 20);
+    ~TraceLog();
+    TraceLog(const TraceLog&) = delete;
+    TraceLog& operator=(const TraceLog&) = delete;
+
+    bool ok() const { return out != nullptr; }
+
+    //событие текущего потока, при переполнении кольца отбрасывается и считается в dropped
+    void event(TraceKind kind, uint32_t code, const char* args = nullptr, size_t args_len = 0, uint64_t span = 0);
+    //описание кода, один раз на id, до первого его события
+    void code(uint32_t id, const std::string& qualified, const std::string& filename, int line);
+    //имя потока в JSON, остальные потоки показываются по tid
+    void thread_name(uint64_t thread, const std::string& name);
+
+    //останавливает писателя, дописывает коды и статистику
+    void close();
+    uint64_t events();
+    uint64_t dropped();
+};
+
+//текст из .pytrace: события по порядку с длительностями, потери по потокам
+bool decode_trace(const std::string& path, std::ostream& out);
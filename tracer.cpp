@@ -0,0 +1,1067 @@
+#include "tracer.h"
+#include "tracelog.h"
+#include "capture.h"
+#include "hooks.h"
+#include <Python.h>
+#include <frameobject.h>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <filesystem>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <condition_variable>
+#include <fstream>
+#include <climits>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static bool g_time_profiling = false;
+static HookMatcher g_hooks;
+static TraceLog* g_log = nullptr;   //-log: события в бинарный лог вместо консоли
+static TraceLog* g_chrome = nullptr;    //-trace-out: то же в Chrome Trace Event JSON
+static uint32_t g_next_code_id = 0;
+static std::vector<std::string> g_code_names;  //по id, переживают code object
+static bool g_track_returns = false;   //выходы нужны для -time и лога
+static CaptureOptions g_capture;
+static uint64_t g_slow_ns = 0;      //-slow: вместо каждого вызова - только медленные, с подробностями
+
+static inline bool is_internal_filename(const char* filename) {
+    if (!filename) return true;
+    return filename[0] == '<';
+}
+
+//решение по хукам для одного code object, считается один раз на первом событии
+//и хранится в co_extra - дальше на событие только чтение указателя, без атрибутов и строк
+//module берется из globals первого фрейма: у кода модуля globals всегда одни и те же
+struct CodeInfo {
+    bool hooked = false;
+    uint32_t id = 0;        //номер в логе, только у хукнутых
+    uint32_t sample = UINT32_MAX;   //имя в профиле -sample
+    bool generator = false;     //генератор или корутина: вход/выход бывают и продолжением/приостановкой
+    bool coroutine = false;     //async def: в -trace-out еще асинхронный отрезок на всю жизнь
+    int line = 0;
+    std::string qualified;
+    std::string filename;
+    std::vector<std::string> args;  //имена параметров, включая *args и **kwargs
+};
+
+#if PY_VERSION_HEX >= 0x030C0000
+#define CODE_EXTRA_INDEX PyUnstable_Eval_RequestCodeExtraIndex
+#define CODE_GET_EXTRA PyUnstable_Code_GetExtra
+#define CODE_SET_EXTRA PyUnstable_Code_SetExtra
+#else
+#define CODE_EXTRA_INDEX _PyEval_RequestCodeExtraIndex
+#define CODE_GET_EXTRA _PyCode_GetExtra
+#define CODE_SET_EXTRA _PyCode_SetExtra
+#endif
+
+static Py_ssize_t g_code_extra = -1;
+
+//вызывается интерпретатором при удалении code object, в том числе в Py_Finalize
+static void free_code_info(void* extra) {
+    delete static_cast<CodeInfo*>(extra);
+}
+
+static void resolve_code(PyFrameObject* frame, PyCodeObject* code, CodeInfo& info) {
+    //имя функции и файл
+    PyObject* name_obj = PyObject_GetAttrString((PyObject*)code, "co_name");
+    PyObject* file_obj = PyObject_GetAttrString((PyObject*)code, "co_filename");
+
+    const char* func_name_c = nullptr;
+    const char* filename_c = nullptr;
+
+    if (name_obj && PyUnicode_Check(name_obj))
+        func_name_c = PyUnicode_AsUTF8(name_obj);
+    if (file_obj && PyUnicode_Check(file_obj))
+        filename_c = PyUnicode_AsUTF8(file_obj);
+
+    if (func_name_c && func_name_c[0] != '\0') {
+        // имя модуля текущего контекста
+        const char* module_c = nullptr;
+        PyObject* globals = PyFrame_GetGlobals(frame);
+        if (globals) {
+            PyObject* modname = PyDict_GetItemString(globals, "__name__");
+            if (modname && PyUnicode_Check(modname))
+                module_c = PyUnicode_AsUTF8(modname);
+            Py_DECREF(globals);
+        }
+
+        //co_qualname (3.11+) с классом: Class.method, outer.<locals>.inner
+        std::string func_name = func_name_c;
+        std::string qualname = func_name;
+        PyObject* qualname_obj = PyObject_GetAttrString((PyObject*)code, "co_qualname");
+        if (qualname_obj && PyUnicode_Check(qualname_obj)) {
+            const char* q = PyUnicode_AsUTF8(qualname_obj);
+            if (q && q[0] != '\0') qualname = q;
+        }
+        Py_XDECREF(qualname_obj);
+        PyErr_Clear();
+
+        std::string module = (module_c && module_c[0] != '\0') ? std::string(module_c) + "." : "";
+        info.qualified = module + qualname;
+        // фильтр внутренних файлов
+        //шаблон проверяется на имени, Class.method, module.name и module.Class.method
+        //тело модуля не хукается: pkg.api.* иначе ловит и импорт pkg.api
+        info.hooked = !is_internal_filename(filename_c) && func_name != "<module>" &&
+                      (g_hooks.match(func_name) || g_hooks.match(qualname) || g_hooks.match(module + func_name) || g_hooks.match(info.qualified));
+        if (info.hooked) {
+            info.filename = filename_c;
+            info.id = g_next_code_id++;
+            g_code_names.push_back(info.qualified);
+            info.line = code->co_firstlineno;
+            info.generator = code->co_flags & (CO_GENERATOR | CO_COROUTINE | CO_ASYNC_GENERATOR | CO_ITERABLE_COROUTINE);
+            info.coroutine = code->co_flags & (CO_COROUTINE | CO_ASYNC_GENERATOR);
+            int count = code->co_argcount + code->co_kwonlyargcount +
+                        ((code->co_flags & CO_VARARGS) ? 1 : 0) + ((code->co_flags & CO_VARKEYWORDS) ? 1 : 0);
+            PyObject* varnames = PyObject_GetAttrString((PyObject*)code, "co_varnames");
+            if (varnames && PyTuple_Check(varnames)) {
+                for (int i = 0; i < count && i < PyTuple_GET_SIZE(varnames); i++) {
+                    const char* arg = PyUnicode_AsUTF8(PyTuple_GET_ITEM(varnames, i));
+                    if (arg) info.args.push_back(arg);
+                }
+            }
+            Py_XDECREF(varnames);
+            if (g_log) g_log->code(info.id, info.qualified, info.filename, info.line);
+            if (g_chrome) g_chrome->code(info.id, info.qualified, info.filename, info.line);
+        }
+    }
+
+    Py_XDECREF(name_obj);
+    Py_XDECREF(file_obj);
+    PyErr_Clear();
+}
+
+static CodeInfo* code_info(PyFrameObject* frame, PyCodeObject* code) {
+    void* extra = nullptr;
+    if (g_code_extra >= 0 && CODE_GET_EXTRA((PyObject*)code, g_code_extra, &extra) == 0 && extra)
+        return static_cast<CodeInfo*>(extra);
+
+    CodeInfo* info = new CodeInfo();
+    resolve_code(frame, code, *info);
+    if (g_code_extra >= 0 && CODE_SET_EXTRA((PyObject*)code, g_code_extra, info) == 0)
+        return info;
+
+    //слот недоступен - считаем каждый раз
+    PyErr_Clear();
+    static thread_local CodeInfo uncached;
+    uncached = std::move(*info);
+    delete info;
+    return &uncached;
+}
+
+//задержки вызовов: лог-линейная гистограмма как HDR, 64 поддиапазона на октаву (точность ~1.5%)
+//память растет только до самого большого записанного значения
+struct LatencyHistogram {
+    static constexpr int SUB_BITS = 7;
+    static constexpr uint64_t SUB = 1 << SUB_BITS;
+    static constexpr uint64_t HALF = SUB / 2;
+
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+
+    static size_t index(uint64_t v) {
+        if (v < SUB) return (size_t)v;
+        int shift = 63 - __builtin_clzll(v) - (SUB_BITS - 1);
+        return (size_t)(shift * HALF + (v >> shift));
+    }
+
+    //нижняя граница значений в ячейке i
+    static uint64_t lower(size_t i) {
+        if (i < SUB) return i;
+        int shift = (int)(i / HALF) - 1;
+        return (uint64_t)(i - shift * HALF) << shift;
+    }
+
+    void record(uint64_t v) {
+        size_t i = index(v);
+        if (i >= counts.size()) counts.resize(i + 1);
+        counts[i]++;
+        total++;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        if (other.counts.size() > counts.size()) counts.resize(other.counts.size());
+        for (size_t i = 0; i < other.counts.size(); i++) counts[i] += other.counts[i];
+        total += other.total;
+    }
+
+    //верхняя граница ячейки, в которую попал p-й квантиль
+    uint64_t percentile(double p) const {
+        if (!total) return 0;
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(p * total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= rank) return lower(i + 1) - 1;
+        }
+        return lower(counts.size()) - 1;
+    }
+};
+
+struct FuncStats {
+    uint64_t calls = 0;
+    uint64_t total_ns = 0;      //inclusive, у рекурсии только внешний вызов
+    uint64_t self_ns = 0;       //без хукнутых потомков
+    uint64_t max_ns = 0;        //как и latency - на весь вызов, у генератора это сумма отрезков
+    LatencyHistogram latency;   //только завершенные вызовы
+    uint32_t active = 0;        //вызовов этой функции на стеке потока
+
+    void merge(const FuncStats& other) {
+        calls += other.calls;
+        total_ns += other.total_ns;
+        self_ns += other.self_ns;
+        max_ns = std::max(max_ns, other.max_ns);
+        latency.merge(other.latency);
+    }
+};
+
+//активный вызов хукнутой функции, фрейм - для сопоставления выхода (рекурсия, генераторы)
+struct ShadowFrame {
+    const CodeInfo* info;
+    PyFrameObject* frame;
+    uint64_t start;
+    uint64_t children = 0;
+    size_t children_at = 0;     //начало своих потомков в ThreadTrace::children
+};
+
+//завершенный прямой потомок активного вызова, для разбивки медленного вызова
+struct ChildCall {
+    uint32_t code;
+    uint64_t elapsed;
+};
+
+//теневой стек и статистика одного потока, на пути события без общих блокировок
+struct ThreadTrace {
+    unsigned long thread = 0;
+    std::vector<ShadowFrame> stack;
+    std::vector<FuncStats> stats;    //по id кода
+    //потомки активных вызовов подряд, вызов при выходе обрезает до своего children_at
+    //память переиспользуется, на горячем пути аллокаций нет
+    std::vector<ChildCall> children;
+    //время прошлых отрезков приостановленных генераторов/корутин, до return или исключения
+    //поток, доделавший чужой генератор, видит только свои отрезки
+    std::unordered_map<PyFrameObject*, uint64_t> suspended;
+
+    FuncStats& stat(uint32_t id) {
+        if (id >= stats.size()) stats.resize(id + 1);
+        return stats[id];
+    }
+};
+
+static std::mutex g_threads_mtx;    //только регистрация потока и итоговый отчет
+static std::vector<std::unique_ptr<ThreadTrace>> g_threads;
+static uint64_t g_threads_generation = 0;
+static std::chrono::steady_clock::time_point g_trace_start;
+static unsigned long g_main_thread = 0;
+
+static uint64_t trace_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_trace_start).count();
+}
+
+static ThreadTrace* thread_trace() {
+    struct Cached {
+        uint64_t generation = 0;
+        ThreadTrace* trace = nullptr;
+    };
+    static thread_local Cached cached;
+    if (cached.generation == g_threads_generation) return cached.trace;
+
+    auto t = std::make_unique<ThreadTrace>();
+    t->thread = PyThread_get_thread_native_id();
+    t->stack.reserve(64);
+    t->children.reserve(1024);
+    cached.trace = t.get();
+    cached.generation = g_threads_generation;
+    std::lock_guard<std::mutex> lk(g_threads_mtx);
+    g_threads.push_back(std::move(t));
+    return cached.trace;
+}
+
+static std::string thread_label(unsigned long thread) {
+    return "thread " + std::to_string(thread) + (thread == g_main_thread ? " (main)" : "");
+}
+
+//событие в -log и -trace-out; id отрезков корутины - ее фрейм, он живет, пока жива корутина
+static void log_event(TraceKind kind, const CodeInfo& info, PyFrameObject* frame, const char* args = nullptr, size_t args_len = 0) {
+    uint64_t span = info.coroutine ? (uint64_t)(uintptr_t)frame : 0;
+    if (g_log) g_log->event(kind, info.id, args, args_len, span);
+    if (g_chrome) g_chrome->event(kind, info.id, args, args_len, span);
+}
+
+//вход в хукнутую функцию, общий для обоих бэкендов
+//resume - продолжение генератора/корутины: новый отрезок времени, но не новый вызов
+static void on_call(PyFrameObject* frame, const CodeInfo& info, bool resume = false) {
+    //-slow без лога ничего не выводит на входе: аргументы попадут в отчет медленного вызова
+    if (resume) {
+        log_event(TraceKind::RESUME, info, frame);
+    } else if (g_log || g_chrome) {
+        std::string args;
+        capture_args(frame, info.args, g_capture, args);
+        log_event(TraceKind::CALL, info, frame, args.data(), args.size());
+    } else if (!g_slow_ns) {
+        //хуки
+        std::string args;
+        capture_args(frame, info.args, g_capture, args);
+        int line = PyFrame_GetLineNumber(frame);
+        unsigned long thread = PyThread_get_thread_native_id();
+        std::cout << "\nHOOKED: " << info.qualified << " (Line: " << line << " in " << info.filename;
+        if (thread != g_main_thread) std::cout << ", thread " << thread;
+        std::cout << ")" << std::endl;
+        if (g_capture.mode != ArgCapture::NONE) {
+            std::cout << "   Args (" << info.args.size() << " total):" << std::endl;
+            std::cout << args << std::endl;
+        }
+    }
+
+    //профилирование, время после вывода аргументов, чтобы не приписывать его функции
+    if (g_time_profiling || g_slow_ns) {
+        ThreadTrace* t = thread_trace();
+        FuncStats& s = t->stat(info.id);
+        if (!resume) s.calls++;
+        s.active++;
+        t->stack.push_back({&info, frame, trace_now(), 0, t->children.size()});
+    }
+}
+
+//подробности медленного вызова, фрейм еще жив: аргументы - значения на момент выхода
+static void report_slow(PyFrameObject* frame, const ShadowFrame& f, uint64_t elapsed, const ThreadTrace* t) {
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "\nSLOW: " << f.info->qualified << " " << ms(elapsed) << " ms in " << f.info->filename << ":" << f.info->line
+              << ", " << thread_label(t->thread) << std::endl;
+
+    //цепочка вызывающих по фреймам Python, не только хукнутым
+    std::cout << "   callers:";
+    PyFrameObject* back = PyFrame_GetBack(frame);
+    for (int depth = 0; back && depth < 8; depth++) {
+        PyCodeObject* code = PyFrame_GetCode(back);
+        std::cout << (depth ? " <- " : " ") << code_info(back, code)->qualified << ":" << PyFrame_GetLineNumber(back);
+        Py_DECREF(code);
+        PyFrameObject* next = PyFrame_GetBack(back);
+        Py_DECREF(back);
+        back = next;
+    }
+    Py_XDECREF(back);
+    std::cout << std::endl;
+
+    if (g_capture.mode != ArgCapture::NONE && !f.info->args.empty()) {
+        std::string args;
+        capture_args(frame, f.info->args, g_capture, args);
+        std::cout << "   args:" << std::endl;
+        std::istringstream lines(args);
+        std::string line;
+        while (std::getline(lines, line)) std::cout << "      " << line << std::endl;
+    }
+
+    //прямые хукнутые потомки по функциям
+    std::vector<std::pair<uint32_t, std::pair<uint64_t, uint64_t>>> by_code;
+    for (size_t i = f.children_at; i < t->children.size(); i++) {
+        const ChildCall& c = t->children[i];
+        auto it = std::find_if(by_code.begin(), by_code.end(), [&](const auto& e) { return e.first == c.code; });
+        if (it == by_code.end()) it = by_code.insert(by_code.end(), {c.code, {0, 0}});
+        it->second.first++;
+        it->second.second += c.elapsed;
+    }
+    std::sort(by_code.begin(), by_code.end(), [](const auto& a, const auto& b) { return a.second.second > b.second.second; });
+    if (!by_code.empty()) {
+        std::cout << "   children:" << std::endl;
+        for (const auto& c : by_code) {
+            std::cout << "      " << g_code_names[c.first] << ": " << c.second.first << " calls, " << ms(c.second.second) << " ms" << std::endl;
+        }
+    }
+    std::cout << "   self: " << ms(elapsed - std::min(f.children, elapsed)) << " ms" << std::endl;
+}
+
+//выход из хукнутой функции (return, yield или исключение)
+static void on_return(PyFrameObject* frame, const CodeInfo& info, TraceKind kind) {
+    log_event(kind, info, frame);
+    if (!g_time_profiling && !g_slow_ns) return;
+
+    uint64_t now = trace_now();
+    ThreadTrace* t = thread_trace();
+    auto& stack = t->stack;
+    //свой фрейм ищем сверху: выше могут остаться вызовы, выход из которых не пришел
+    size_t i = stack.size();
+    while (i > 0 && stack[i - 1].frame != frame) i--;
+    if (i == 0) {
+        //вход был до начала трассировки, или close()/throw() без resume - отрезки генератора не нужны
+        if (kind != TraceKind::YIELD && !t->suspended.empty()) t->suspended.erase(frame);
+        return;
+    }
+    for (size_t j = i; j < stack.size(); j++) t->stat(stack[j].info->id).active--;
+    stack.resize(i);
+
+    ShadowFrame f = stack.back();
+    stack.pop_back();
+    uint64_t elapsed = now - f.start;
+    FuncStats& s = t->stat(info.id);
+    if (--s.active == 0) s.total_ns += elapsed;
+    s.self_ns += elapsed - std::min(f.children, elapsed);
+    //гистограмма по вызовам, как calls: yield копит отрезок, выход записывает сумму
+    if (kind == TraceKind::YIELD) {
+        t->suspended[frame] += elapsed;
+    } else {
+        uint64_t call_ns = elapsed;
+        if (!t->suspended.empty()) {
+            auto it = t->suspended.find(frame);
+            if (it != t->suspended.end()) {
+                call_ns += it->second;
+                t->suspended.erase(it);
+            }
+        }
+        s.max_ns = std::max(s.max_ns, call_ns);
+        s.latency.record(call_ns);
+    }
+
+    if (g_slow_ns && elapsed >= g_slow_ns) {
+        report_slow(frame, f, elapsed, t);
+        //время отчета не должно попасть во внешние вызовы
+        uint64_t cost = trace_now() - now;
+        for (auto& outer : stack) outer.start += cost;
+    }
+    t->children.resize(f.children_at);
+    if (!stack.empty()) {
+        stack.back().children += elapsed;
+        t->children.push_back({info.id, elapsed});
+    }
+}
+
+//таблица функций по убыванию общего времени
+static void print_stats(const std::vector<FuncStats>& stats) {
+    std::vector<uint32_t> order;
+    size_t width = 8;
+    for (uint32_t id = 0; id < stats.size() && id < g_code_names.size(); id++) {
+        if (!stats[id].calls && !stats[id].latency.total) continue;
+        order.push_back(id);
+        width = std::max(width, std::min<size_t>(g_code_names[id].size(), 60));
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return stats[a].total_ns > stats[b].total_ns; });
+
+    auto ms = [](uint64_t ns) { return ns / 1e6; };
+    std::cout << std::left << std::setw(width) << "function" << std::right
+              << std::setw(10) << "calls" << std::setw(14) << "total ms" << std::setw(14) << "self ms"
+              << std::setw(12) << "p50 ms" << std::setw(12) << "p99 ms" << std::setw(12) << "p999 ms" << std::setw(12) << "max ms" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (uint32_t id : order) {
+        const FuncStats& s = stats[id];
+        std::cout << std::left << std::setw(width) << g_code_names[id] << std::right
+                  << std::setw(10) << s.calls << std::setw(14) << ms(s.total_ns) << std::setw(14) << ms(s.self_ns)
+                  << std::setw(12) << ms(std::min(s.latency.percentile(0.5), s.max_ns))
+                  << std::setw(12) << ms(std::min(s.latency.percentile(0.99), s.max_ns))
+                  << std::setw(12) << ms(std::min(s.latency.percentile(0.999), s.max_ns))
+                  << std::setw(12) << ms(s.max_ns) << std::endl;
+    }
+}
+
+//итог -time: общая таблица, при нескольких потоках - еще по каждому потоку
+static void print_profile() {
+    std::lock_guard<std::mutex> lk(g_threads_mtx);
+    std::vector<FuncStats> total(g_code_names.size());
+    std::vector<const ThreadTrace*> active;
+    for (const auto& t : g_threads) {
+        bool any = false;
+        for (size_t id = 0; id < t->stats.size() && id < total.size(); id++) {
+            total[id].merge(t->stats[id]);
+            any = any || t->stats[id].calls || t->stats[id].latency.total;
+        }
+        if (any) active.push_back(t.get());
+    }
+
+    std::cout << std::endl;
+    std::cout << "PROFILING RESULT:" << std::endl;
+    print_stats(total);
+    if (active.size() > 1) {
+        for (const ThreadTrace* t : active) {
+            std::cout << std::endl << thread_label(t->thread) << ":" << std::endl;
+            print_stats(t->stats);
+        }
+    }
+
+    uint64_t now = trace_now();
+    bool header = false;
+    for (const auto& t : g_threads) {
+        for (const auto& f : t->stack) {
+            if (!header) std::cout << "   unfinished functions:" << std::endl;
+            header = true;
+            std::cout << "     " << g_code_names[f.info->id] << " [" << thread_label(t->thread) << "]: "
+                      << (now - f.start) / 1e6 << " ms (unfinished)" << std::endl;
+        }
+    }
+}
+
+//settrace не отличает продолжение генератора от вызова и приостановку от возврата
+//смотрим на текущую инструкцию: RESUME с ненулевым аргументом - после yield/await, выход на YIELD_VALUE - приостановка,
+//вход на YIELD_VALUE - close()/throw() в уже начатый генератор, это тоже продолжение
+static int g_op_resume = -2;
+static int g_op_yield = -2;
+//генератор, в который бросили исключение: 3.12 отдает выход по нему с arg None, а не NULL, и тоже на YIELD_VALUE
+static thread_local PyFrameObject* g_thrown_frame = nullptr;
+
+static void frame_opcode(PyFrameObject* frame, PyCodeObject* code, int& op, int& oparg) {
+    int lasti = PyFrame_GetLasti(frame);
+    PyObject* bytes = PyCode_GetCode(code);
+    if (bytes && PyBytes_Check(bytes) && lasti >= 0 && lasti + 1 < PyBytes_GET_SIZE(bytes)) {
+        op = (unsigned char)PyBytes_AS_STRING(bytes)[lasti];
+        oparg = (unsigned char)PyBytes_AS_STRING(bytes)[lasti + 1];
+    }
+    Py_XDECREF(bytes);
+    PyErr_Clear();
+}
+
+static int opcode_number(PyObject* opmap, const char* name) {
+    PyObject* v = opmap ? PyDict_GetItemString(opmap, name) : nullptr;
+    return v && PyLong_Check(v) ? (int)PyLong_AsLong(v) : -2;
+}
+
+//старый бэкенд: PyEval_SetTrace, сюда приходят все события всех функций
+static int trace_func(PyObject* obj, PyFrameObject* frame, int what, PyObject* arg) {
+    if (!frame) return 0;
+    if (what != PyTrace_CALL && !(g_track_returns && what == PyTrace_RETURN)) return 0;
+
+    PyCodeObject* code = PyFrame_GetCode(frame); //байткод из фрейма
+    if (!code) return 0;
+
+    const CodeInfo* info = code_info(frame, code);
+    if (info->hooked) {
+        int op = -1, oparg = 0;
+        if (info->generator) frame_opcode(frame, code, op, oparg);
+        if (what == PyTrace_CALL) {
+            if (op == g_op_yield) g_thrown_frame = frame;
+            on_call(frame, *info, op == g_op_yield || (op == g_op_resume && oparg != 0));
+        } else {
+            bool unwind = !arg || (frame == g_thrown_frame && arg == Py_None && op == g_op_yield);
+            if (frame == g_thrown_frame) g_thrown_frame = nullptr;
+            on_return(frame, *info, unwind ? TraceKind::UNWIND : op == g_op_yield ? TraceKind::YIELD : TraceKind::RETURN);
+        }
+    }
+
+    Py_DECREF(code);
+    return 0;
+}
+
+//settrace ставится только на вызвавший поток (PyEval_SetTraceAllThreads на 3.12+ - только на уже существующие)
+//новые потоки: threading.settrace с колбэком, который первым событием потока
+//переключает его на trace_func и сам это событие обрабатывает
+static PyObject* thread_bootstrap(PyObject*, PyObject* const* args, Py_ssize_t nargs) {
+    PyEval_SetTrace(trace_func, nullptr);
+    if (nargs >= 2 && PyFrame_Check(args[0]) && PyUnicode_Check(args[1]) && PyUnicode_CompareWithASCIIString(args[1], "call") == 0) {
+        trace_func(nullptr, (PyFrameObject*)args[0], PyTrace_CALL, Py_None);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef g_bootstrap_method = {"pysec_thread_trace", (PyCFunction)(void(*)(void))thread_bootstrap, METH_FASTCALL, nullptr};
+
+static void threading_settrace(PyObject* func) {
+    PyObject* threading = PyImport_ImportModule("threading");
+    PyObject* r = threading ? PyObject_CallMethod(threading, "settrace", "O", func) : nullptr;
+    Py_XDECREF(r);
+    Py_XDECREF(threading);
+    if (!r) PyErr_Print();
+}
+
+static void install_settrace() {
+    PyObject* opcode = PyImport_ImportModule("opcode");
+    PyObject* opmap = opcode ? PyObject_GetAttrString(opcode, "opmap") : nullptr;
+    g_op_resume = opcode_number(opmap, "RESUME");
+    g_op_yield = opcode_number(opmap, "YIELD_VALUE");
+    Py_XDECREF(opmap);
+    Py_XDECREF(opcode);
+    PyErr_Clear();
+
+#if PY_VERSION_HEX >= 0x030C0000
+    PyEval_SetTraceAllThreads(trace_func, nullptr);
+#else
+    PyEval_SetTrace(trace_func, nullptr);
+#endif
+    PyObject* bootstrap = PyCFunction_New(&g_bootstrap_method, nullptr);
+    if (bootstrap) {
+        threading_settrace(bootstrap);
+        Py_DECREF(bootstrap);
+    }
+}
+
+static void remove_settrace() {
+    threading_settrace(Py_None);
+#if PY_VERSION_HEX >= 0x030C0000
+    PyEval_SetTraceAllThreads(nullptr, nullptr);
+#else
+    PyEval_SetTrace(nullptr, nullptr);
+#endif
+}
+
+//бэкенд sys.monitoring (PEP 669)
+//PY_START/PY_RETURN - локальные события, для нехукнутого кода колбэк возвращает DISABLE
+//и интерпретатор больше не вызывает его для этого места, остальная программа идет почти без накладных расходов
+static const int MONITOR_TOOL_ID = 2;   //sys.monitoring.PROFILER_ID
+static PyObject* g_monitoring = nullptr;
+static PyObject* g_disable = nullptr;
+
+//колбэк для кода args[0]: фрейм этого кода - текущий, nullptr если код не хукнут
+static const CodeInfo* monitor_code(PyObject* const* args, Py_ssize_t nargs, PyFrameObject** frame_out) {
+    if (nargs < 1 || !PyCode_Check(args[0])) return nullptr;
+    PyFrameObject* frame = PyEval_GetFrame();
+    if (!frame) return nullptr;
+    const CodeInfo* info = code_info(frame, (PyCodeObject*)args[0]);
+    *frame_out = frame;
+    return info->hooked ? info : nullptr;
+}
+
+static PyObject* monitor_disable() {
+    Py_INCREF(g_disable);
+    return g_disable;
+}
+
+static PyObject* monitor_start(PyObject*, PyObject* const* args, Py_ssize_t nargs) {
+    PyFrameObject* frame = nullptr;
+    const CodeInfo* info = monitor_code(args, nargs, &frame);
+    if (!info) return monitor_disable();
+    on_call(frame, *info);
+    Py_RETURN_NONE;
+}
+
+static PyObject* monitor_return(PyObject*, PyObject* const* args, Py_ssize_t nargs) {
+    PyFrameObject* frame = nullptr;
+    const CodeInfo* info = monitor_code(args, nargs, &frame);
+    if (!info) return monitor_disable();
+    on_return(frame, *info, TraceKind::RETURN);
+    Py_RETURN_NONE;
+}
+
+static PyObject* monitor_resume(PyObject*, PyObject* const* args, Py_ssize_t nargs) {
+    PyFrameObject* frame = nullptr;
+    const CodeInfo* info = monitor_code(args, nargs, &frame);
+    if (!info) return monitor_disable();
+    on_call(frame, *info, true);
+    Py_RETURN_NONE;
+}
+
+static PyObject* monitor_yield(PyObject*, PyObject* const* args, Py_ssize_t nargs) {
+    PyFrameObject* frame = nullptr;
+    const CodeInfo* info = monitor_code(args, nargs, &frame);
+    if (!info) return monitor_disable();
+    on_return(frame, *info, TraceKind::YIELD);
+    Py_RETURN_NONE;
+}
+
+//PY_UNWIND нелокальное и не отключается через DISABLE, приходит только при выходе по исключению
+static PyObject* monitor_unwind(PyObject*, PyObject* const* args, Py_ssize_t nargs) {
+    PyFrameObject* frame = nullptr;
+    const CodeInfo* info = monitor_code(args, nargs, &frame);
+    if (info) on_return(frame, *info, TraceKind::UNWIND);
+    Py_RETURN_NONE;
+}
+
+//PY_THROW (close()/throw() в приостановленный генератор) тоже нелокальное: resume без DISABLE
+static PyObject* monitor_throw(PyObject*, PyObject* const* args, Py_ssize_t nargs) {
+    PyFrameObject* frame = nullptr;
+    const CodeInfo* info = monitor_code(args, nargs, &frame);
+    if (info) on_call(frame, *info, true);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef g_monitor_methods[] = {
+    {"pysec_start", (PyCFunction)(void(*)(void))monitor_start, METH_FASTCALL, nullptr},
+    {"pysec_return", (PyCFunction)(void(*)(void))monitor_return, METH_FASTCALL, nullptr},
+    {"pysec_unwind", (PyCFunction)(void(*)(void))monitor_unwind, METH_FASTCALL, nullptr},
+    {"pysec_resume", (PyCFunction)(void(*)(void))monitor_resume, METH_FASTCALL, nullptr},
+    {"pysec_yield", (PyCFunction)(void(*)(void))monitor_yield, METH_FASTCALL, nullptr},
+    {"pysec_throw", (PyCFunction)(void(*)(void))monitor_throw, METH_FASTCALL, nullptr},
+};
+
+static long monitor_event(PyObject* events, const char* name) {
+    PyObject* value = PyObject_GetAttrString(events, name);
+    long result = value ? PyLong_AsLong(value) : 0;
+    Py_XDECREF(value);
+    return result;
+}
+
+static bool monitor_register(PyObject* events, const char* event, PyMethodDef* def) {
+    PyObject* callback = PyCFunction_New(def, nullptr);
+    if (!callback) return false;
+    PyObject* r = PyObject_CallMethod(g_monitoring, "register_callback", "ilO", MONITOR_TOOL_ID, monitor_event(events, event), callback);
+    Py_DECREF(callback);
+    Py_XDECREF(r);
+    return r != nullptr;
+}
+
+//false - sys.monitoring нет (< 3.12) или tool id занят, тогда нужен PyEval_SetTrace
+static bool install_monitoring() {
+    PyObject* sys = PyImport_ImportModule("sys");
+    if (!sys) { PyErr_Clear(); return false; }
+    g_monitoring = PyObject_GetAttrString(sys, "monitoring");
+    Py_DECREF(sys);
+    if (!g_monitoring) { PyErr_Clear(); return false; }
+
+    PyObject* r = PyObject_CallMethod(g_monitoring, "use_tool_id", "is", MONITOR_TOOL_ID, "pysec");
+    if (!r) {
+        PyErr_Clear();
+        Py_CLEAR(g_monitoring);
+        return false;
+    }
+    Py_DECREF(r);
+
+    g_disable = PyObject_GetAttrString(g_monitoring, "DISABLE");
+    PyObject* events = PyObject_GetAttrString(g_monitoring, "events");
+    bool ok = g_disable && events;
+    long mask = 0;
+    if (ok) {
+        ok = monitor_register(events, "PY_START", &g_monitor_methods[0]);
+        mask = monitor_event(events, "PY_START");
+        if (ok && g_track_returns) {
+            //yield/resume генераторов и корутин - отдельные отрезки, иначе стек рассинхронизируется
+            ok = monitor_register(events, "PY_RETURN", &g_monitor_methods[1]) &&
+                 monitor_register(events, "PY_UNWIND", &g_monitor_methods[2]) &&
+                 monitor_register(events, "PY_RESUME", &g_monitor_methods[3]) &&
+                 monitor_register(events, "PY_YIELD", &g_monitor_methods[4]) &&
+                 monitor_register(events, "PY_THROW", &g_monitor_methods[5]);
+            mask |= monitor_event(events, "PY_RETURN") | monitor_event(events, "PY_UNWIND") |
+                    monitor_event(events, "PY_RESUME") | monitor_event(events, "PY_YIELD") |
+                    monitor_event(events, "PY_THROW");
+        }
+    }
+    if (ok) {
+        r = PyObject_CallMethod(g_monitoring, "set_events", "il", MONITOR_TOOL_ID, mask);
+        ok = r != nullptr;
+        Py_XDECREF(r);
+    }
+    Py_XDECREF(events);
+
+    if (!ok) {
+        PyErr_Print();
+        r = PyObject_CallMethod(g_monitoring, "free_tool_id", "i", MONITOR_TOOL_ID);
+        Py_XDECREF(r);
+        PyErr_Clear();
+        Py_CLEAR(g_disable);
+        Py_CLEAR(g_monitoring);
+    }
+    return ok;
+}
+
+static void remove_monitoring() {
+    if (!g_monitoring) return;
+    PyObject* r = PyObject_CallMethod(g_monitoring, "set_events", "ii", MONITOR_TOOL_ID, 0);
+    Py_XDECREF(r);
+    r = PyObject_CallMethod(g_monitoring, "free_tool_id", "i", MONITOR_TOOL_ID);
+    Py_XDECREF(r);
+    PyErr_Clear();
+    Py_CLEAR(g_disable);
+    Py_CLEAR(g_monitoring);
+}
+
+//статистический профайлер -sample: фоновый поток раз в период берет GIL и снимает стеки всех потоков
+//пока программа держит GIL, интерпретатор отдает его только через switch interval (5 мс),
+//поэтому вес сэмпла - число прошедших периодов, доли функций от этого не искажаются
+class Sampler {
+private:
+    //префиксное дерево стеков: узел - (родитель, функция), ребра в хеш-таблице
+    struct Node {
+        uint32_t parent;
+        uint32_t name;
+        uint64_t self = 0;
+    };
+
+    int hz;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint32_t> name_index;   //одноименные функции разных code object - одно имя
+    std::vector<Node> nodes{{0, UINT32_MAX}};   //0 - корень
+    std::unordered_map<uint64_t, uint32_t> children;
+    std::vector<uint64_t> self_ticks;
+    std::vector<uint64_t> total_ticks;
+    uint64_t samples = 0;
+    uint64_t ticks = 0;
+    uint64_t thread_ticks = 0;  //сумма по потокам, база для процентов
+    std::chrono::steady_clock::time_point started;
+
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static constexpr size_t MAX_DEPTH = 256;
+
+    uint32_t child(uint32_t parent, uint32_t name) {
+        uint64_t key = ((uint64_t)parent << 32) | name;
+        auto it = children.find(key);
+        if (it != children.end()) return it->second;
+        uint32_t id = (uint32_t)nodes.size();
+        nodes.push_back({parent, name});
+        children.emplace(key, id);
+        return id;
+    }
+
+    uint32_t name_of(PyFrameObject* frame) {
+        PyCodeObject* code = PyFrame_GetCode(frame);
+        CodeInfo* info = code_info(frame, code);
+        Py_DECREF(code);
+        if (info->sample == UINT32_MAX) {
+            std::string name = info->qualified.empty() ? "<unknown>" : info->qualified;
+            auto it = name_index.find(name);
+            if (it == name_index.end()) {
+                it = name_index.emplace(name, (uint32_t)names.size()).first;
+                names.push_back(name);
+                self_ticks.push_back(0);
+                total_ticks.push_back(0);
+            }
+            info->sample = it->second;
+        }
+        return info->sample;
+    }
+
+    //вызывать с GIL
+    void take(uint64_t weight) {
+        std::vector<uint32_t> stack;
+        for (PyThreadState* ts = PyInterpreterState_ThreadHead(PyInterpreterState_Main()); ts; ts = PyThreadState_Next(ts)) {
+            stack.clear();
+            PyFrameObject* frame = PyThreadState_GetFrame(ts);
+            while (frame && stack.size() < MAX_DEPTH) {
+                stack.push_back(name_of(frame));
+                PyFrameObject* back = PyFrame_GetBack(frame);
+                Py_DECREF(frame);
+                frame = back;
+            }
+            Py_XDECREF(frame);
+            if (stack.empty()) continue;
+
+            uint32_t node = 0;
+            for (auto it = stack.rbegin(); it != stack.rend(); ++it) node = child(node, *it);
+            nodes[node].self += weight;
+            self_ticks[stack.front()] += weight;
+            //рекурсивная функция в total один раз на сэмпл
+            std::sort(stack.begin(), stack.end());
+            stack.erase(std::unique(stack.begin(), stack.end()), stack.end());
+            for (uint32_t name : stack) total_ticks[name] += weight;
+            thread_ticks += weight;
+            samples++;
+        }
+        ticks += weight;
+    }
+
+    void run() {
+        auto period = std::chrono::nanoseconds(1000000000LL / hz);
+        auto last = std::chrono::steady_clock::now();
+        auto next = last + period;
+        std::unique_lock<std::mutex> lk(mtx);
+        while (!wake.wait_until(lk, next, [this] { return stopping; })) {
+            lk.unlock();
+            PyGILState_STATE gil = PyGILState_Ensure();
+            auto now = std::chrono::steady_clock::now();
+            uint64_t weight = std::max<int64_t>(1, std::llround((double)(now - last).count() / period.count()));
+            last = now;
+            take(weight);
+            PyGILState_Release(gil);
+            next += period;
+            if (next <= now) next = now + period;
+            lk.lock();
+        }
+    }
+
+public:
+    explicit Sampler(int hz) : hz(hz) {}
+
+    void start() {
+        started = std::chrono::steady_clock::now();
+        worker = std::thread([this] { run(); });
+    }
+
+    //вызывать с GIL: на время ожидания потока GIL отпускается
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        Py_BEGIN_ALLOW_THREADS
+        if (worker.joinable()) worker.join();
+        Py_END_ALLOW_THREADS
+    }
+
+    //формат collapsed stacks (flamegraph.pl, speedscope): a;b;c count
+    bool write_collapsed(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "cant open " << path << "\n";
+            return false;
+        }
+        std::vector<uint32_t> chain;
+        for (uint32_t id = 1; id < nodes.size(); id++) {
+            if (!nodes[id].self) continue;
+            chain.clear();
+            for (uint32_t n = id; n != 0; n = nodes[n].parent) chain.push_back(nodes[n].name);
+            for (size_t i = chain.size(); i > 0; i--) {
+                out << names[chain[i - 1]] << (i > 1 ? ";" : "");
+            }
+            out << " " << nodes[id].self << "\n";
+        }
+        return true;
+    }
+
+    void print_report(size_t top = 30) const {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::vector<uint32_t> order;
+        size_t width = 8;
+        for (uint32_t id = 0; id < names.size(); id++) {
+            order.push_back(id);
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return self_ticks[a] != self_ticks[b] ? self_ticks[a] > self_ticks[b] : total_ticks[a] > total_ticks[b];
+        });
+        if (order.size() > top) order.resize(top);
+        for (uint32_t id : order) width = std::max(width, std::min<size_t>(names[id].size(), 60));
+
+        auto pct = [&](uint64_t v) { return thread_ticks ? 100.0 * v / thread_ticks : 0.0; };
+        std::cout << std::endl;
+        std::cout << "SAMPLING RESULT: " << ticks << " ticks at " << hz << " Hz, " << samples << " stacks in "
+                  << std::fixed << std::setprecision(3) << seconds << " s" << std::endl;
+        std::cout << std::left << std::setw(width) << "function" << std::right
+                  << std::setw(10) << "self" << std::setw(9) << "self %" << std::setw(10) << "total" << std::setw(9) << "total %" << std::endl;
+        std::cout << std::setprecision(1);
+        for (uint32_t id : order) {
+            std::cout << std::left << std::setw(width) << names[id] << std::right
+                      << std::setw(10) << self_ticks[id] << std::setw(9) << pct(self_ticks[id])
+                      << std::setw(10) << total_ticks[id] << std::setw(9) << pct(total_ticks[id]) << std::endl;
+        }
+    }
+};
+
+int run_traced(const std::string& script_path, const TraceOptions& options) {
+    g_code_names.clear();
+    {
+        std::lock_guard<std::mutex> lk(g_threads_mtx);
+        g_threads.clear();
+        g_threads_generation++;
+    }
+    g_hooks = HookMatcher();
+    for (const auto& hook : options.hooks) g_hooks.add(hook);
+    g_time_profiling = options.time;
+    g_capture = options.capture;
+    g_slow_ns = options.slow_ms > 0 ? (uint64_t)(options.slow_ms * 1e6) : 0;
+    g_next_code_id = 0;
+
+    bool tracing = !g_hooks.empty();
+    if (!tracing && options.sample_hz <= 0) {
+        std::cerr << "Error: no hooks" << std::endl;
+        return 1;
+    }
+
+    Py_Initialize();
+    g_code_extra = CODE_EXTRA_INDEX(free_code_info);
+
+    PyObject* globals = PyDict_New();
+    PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins());
+
+    PyObject* name_obj = PyUnicode_FromString("__main__"); // имя модуля __name__ = '__main__'
+    PyDict_SetItemString(globals, "__name__", name_obj);
+    Py_DECREF(name_obj);
+
+    PyObject* file_obj = PyUnicode_FromString(script_path.c_str());
+    PyDict_SetItemString(globals, "__file__", file_obj); //путь к файлу
+    Py_DECREF(file_obj);
+
+    std::string script_dir = fs::path(script_path).parent_path().string(); //для импортов
+    std::string add_path = "import sys; sys.path.insert(0, r'" + script_dir + "')";
+    PyRun_SimpleString(add_path.c_str());
+
+    const char* suppress_py_output = R"PY(
+import sys
+class _NullWriter:
+    def write(self, *_): pass
+    def flush(self): pass
+sys.stdout = _NullWriter()
+sys.stderr = _NullWriter()
+)PY";
+    PyRun_SimpleString(suppress_py_output);
+
+    FILE* fp = fopen(script_path.c_str(), "r");
+    if (!fp) {
+        std::cerr << "cant open script: " << script_path << "\n";
+        Py_DECREF(globals);
+        Py_Finalize();
+        return 1;
+    }
+
+    std::unique_ptr<TraceLog> log;
+    if (!options.log.empty()) {
+        log = std::make_unique<TraceLog>(options.log);
+        if (!log->ok()) {
+            fclose(fp);
+            Py_DECREF(globals);
+            Py_Finalize();
+            return 1;
+        }
+        g_log = log.get();
+    }
+
+    std::unique_ptr<TraceLog> chrome;
+    if (!options.trace_out.empty()) {
+        //JSON пишется медленнее бинарного лога: кольцо больше, чтобы пережить всплески вызовов
+        chrome = std::make_unique<TraceLog>(options.trace_out, TraceFormat::CHROME, 16 << 20);
+        if (!chrome->ok()) {
+            g_log = nullptr;
+            fclose(fp);
+            Py_DECREF(globals);
+            Py_Finalize();
+            return 1;
+        }
+        chrome->thread_name(PyThread_get_thread_native_id(), "main");
+        g_chrome = chrome.get();
+    }
+    g_track_returns = g_time_profiling || g_log || g_chrome || g_slow_ns;
+
+    g_trace_start = std::chrono::steady_clock::now();
+    g_main_thread = PyThread_get_thread_native_id();
+    bool monitoring = false;
+    if (tracing) {
+        monitoring = !options.legacy && install_monitoring();
+        std::cout << "[TRACE] backend: " << (monitoring ? "sys.monitoring" : "settrace") << std::endl;
+        if (!monitoring) install_settrace();
+    }
+
+    std::unique_ptr<Sampler> sampler;
+    if (options.sample_hz > 0) {
+        sampler = std::make_unique<Sampler>(options.sample_hz);
+        sampler->start();
+    }
+
+    PyObject* result = PyRun_FileExFlags(fp, script_path.c_str(), Py_file_input, globals, globals, 1, nullptr);
+
+    //PyErr_Print на SystemExit завершает процесс без отчета
+    if (!result && PyErr_ExceptionMatches(PyExc_SystemExit)) PyErr_Clear();
+    else if (!result) PyErr_Print();
+    else Py_DECREF(result);
+
+    if (sampler) sampler->stop();
+    if (monitoring) remove_monitoring();
+    else if (tracing) remove_settrace();
+
+    if (log) {
+        g_log = nullptr;
+        log->close();
+        std::cout << "[TRACE] log: " << options.log << " (" << log->events() << " events, " << log->dropped() << " dropped)" << std::endl;
+    }
+
+    if (chrome) {
+        g_chrome = nullptr;
+        chrome->close();
+        std::cout << "[TRACE] trace: " << options.trace_out << " (" << chrome->events() << " events, " << chrome->dropped() << " dropped)" << std::endl;
+    }
+
+    if (g_time_profiling) print_profile();
+    if (sampler) {
+        sampler->print_report();
+        std::string out = options.sample_out.empty() ? fs::path(script_path).stem().string() + ".collapsed" : options.sample_out;
+        if (sampler->write_collapsed(out)) std::cout << "[SAMPLE] collapsed stacks: " << out << std::endl;
+    }
+    Py_DECREF(globals);
+    Py_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "capture.h"
+
+//опции -run
+struct TraceOptions {
+    std::vector<std::string> hooks;
+    bool time = false;
+    bool legacy = false;    //PyEval_SetTrace даже если есть sys.monitoring
+    std::string log;        //бинарный лог событий (--decode-trace), пусто - вывод в консоль
+    std::string trace_out;  //-trace-out: Chrome Trace Event JSON для chrome://tracing и Perfetto
+    int sample_hz = 0;      //-sample: статистический профиль, хуки не обязательны
+    std::string sample_out; //collapsed stacks, по умолчанию <script>.collapsed
+    CaptureOptions capture; //-args, -args-bytes, -args-us
+    double slow_ms = 0;     //-slow: печатать только вызовы дольше порога, с аргументами, стеком и потомками
+};
+
+//запуск скрипта под трассировкой хуков и/или сэмплированием, возвращает код выхода для main
+//на 3.12+ - sys.monitoring (PEP 669), иначе PyEval_SetTrace
+int run_traced(const std::string& script_path, const TraceOptions& options);